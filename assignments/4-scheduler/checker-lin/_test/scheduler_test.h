@@ -63,7 +63,7 @@ extern void test_sched_22(void);
 
 static inline tid_t get_tid(void)
 {
-	return pthread_self();
+	return so_self();
 }
 
 static inline int equal_tids(tid_t t1, tid_t t2)
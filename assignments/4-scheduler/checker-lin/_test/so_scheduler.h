@@ -67,6 +67,14 @@ DECL_PREFIX int so_init(unsigned int time_quantum, unsigned int io);
  */
 DECL_PREFIX tid_t so_fork(so_handler *func, unsigned int priority);
 
+/*
+ * identifies the caller; tasks of the green backend share a kernel
+ * thread, so use this rather than pthread_self() to tell them apart
+ * returns: tid so_fork returned for the calling task, or the id of the
+ * calling thread outside of any task
+ */
+DECL_PREFIX tid_t so_self(void);
+
 /*
  * waits for an IO device
  * + device index
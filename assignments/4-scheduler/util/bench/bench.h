@@ -0,0 +1,17 @@
+// Helpers shared by the benchmarks.
+// Every result is printed as one line of key=value pairs that starts with
+// bench=<name>. Keys ending in _ns or _per_sec are measurements, every
+// other key identifies the run, see compare.sh.
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+static inline unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
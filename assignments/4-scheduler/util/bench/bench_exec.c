@@ -0,0 +1,49 @@
+// Cost of so_exec with and without a preemption.
+// A lone task with a large quantum measures the bookkeeping of one call.
+// Two tasks with quantum 1 hand the CPU to each other on every call, so
+// op_ns of that mode is one round trip made of two preemptions.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+static unsigned int no_execs;
+
+static void worker(unsigned int priority) {
+    (void)priority;
+    for (unsigned int i = 0; i < no_execs; ++i) {
+        so_exec();
+    }
+}
+
+static void pair(unsigned int priority) {
+    // both workers are ready before either of them runs
+    so_fork(worker, priority - 1);
+    so_fork(worker, priority - 1);
+}
+
+static int run(const char* mode, unsigned int quantum, so_handler* func,
+               unsigned long long ops) {
+    if (so_init(quantum, 0) < 0) {
+        fprintf(stderr, "so_init failed\n");
+        return -1;
+    }
+    unsigned long long start = now_ns();
+    so_fork(func, 1);
+    so_end();
+    unsigned long long elapsed = now_ns() - start;
+
+    printf("bench=exec mode=%s execs=%u op_ns=%.1f\n",
+           mode, no_execs, (double)elapsed / ops);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    no_execs = argc > 1 ? atoi(argv[1]) : 20000;
+
+    if (run("nopreempt", no_execs + 1, worker, no_execs) < 0 ||
+        run("roundtrip", 1, pair, no_execs) < 0) {
+        return 1;
+    }
+    return 0;
+}
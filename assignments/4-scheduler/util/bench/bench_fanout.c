@@ -0,0 +1,72 @@
+// Fan-out of short handlers, one so_fork per child against one
+// so_fork_many per round. Children run at a higher priority than the
+// forking task, so every so_fork preempts it while so_fork_many queues
+// the whole round first and switches once. Children are detached and the
+// pool keeps their workers for the next round.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+#define MAX_WIDTH 256
+
+static unsigned int no_rounds;
+static unsigned int width;
+static int batch;
+
+static void child(unsigned int priority) {
+    (void)priority;
+}
+
+static void parent(unsigned int priority) {
+    so_handler* funcs[MAX_WIDTH];
+    unsigned int prios[MAX_WIDTH];
+
+    for (unsigned int i = 0; i < width; ++i) {
+        funcs[i] = child;
+        prios[i] = priority + 1;
+    }
+    for (unsigned int r = 0; r < no_rounds; ++r) {
+        if (batch) {
+            so_fork_many(funcs, prios, width, NULL);
+            continue;
+        }
+        for (unsigned int i = 0; i < width; ++i) {
+            so_fork(child, priority + 1);
+        }
+    }
+}
+
+static int run(const char* name, unsigned int w, int use_batch) {
+    so_opts_t opts = {0};
+    opts.pool_size = w;
+    opts.detach = 1;
+    width = w;
+    batch = use_batch;
+
+    if (so_init_ex(1000, 0, &opts) < 0) {
+        fprintf(stderr, "so_init_ex failed\n");
+        return -1;
+    }
+    unsigned long long start = now_ns();
+    so_fork(parent, 0);
+    so_end();
+    unsigned long long elapsed = now_ns() - start;
+
+    printf("bench=fanout mode=%s width=%u rounds=%u child_ns=%.1f round_ns=%.1f\n",
+           name, w, no_rounds, (double)elapsed / ((unsigned long long)no_rounds * w),
+           (double)elapsed / no_rounds);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    static const unsigned int widths[] = { 8, 64 };
+    no_rounds = argc > 1 ? atoi(argv[1]) : 1000;
+
+    for (unsigned int i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        if (run("fork", widths[i], 0) < 0 || run("fork_many", widths[i], 1) < 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// so_wait_fd round trip between two tasks over a socketpair, the same
+// exchange as bench_pingpong with a byte on a real descriptor instead of
+// a device signal. With busy=1 a lower priority task spins in so_exec
+// meanwhile and gets the CPU whenever both of them wait.
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+static unsigned int no_rounds;
+static int fds[2];
+static volatile int done;
+
+static void echo(int fd, int first) {
+    char byte = 0;
+    for (unsigned int i = 0; i < no_rounds; ++i) {
+        if (first && write(fd, &byte, 1) != 1) {
+            break;
+        }
+        if (so_wait_fd(fd, POLLIN) < 0 || read(fd, &byte, 1) != 1) {
+            break;
+        }
+        if (!first && write(fd, &byte, 1) != 1) {
+            break;
+        }
+    }
+}
+
+static void ponger(unsigned int priority) {
+    (void)priority;
+    echo(fds[1], 0);
+}
+
+static void pinger(unsigned int priority) {
+    (void)priority;
+    echo(fds[0], 1);
+    done = 1;
+}
+
+static void spinner(unsigned int priority) {
+    (void)priority;
+    while (!done) {
+        so_exec();
+    }
+}
+
+static int busy;
+
+static void driver(unsigned int priority) {
+    so_fork(ponger, priority + 1);
+    so_fork(pinger, priority + 1);
+    if (busy) {
+        so_fork(spinner, priority - 1);
+    }
+}
+
+static int run(int with_spinner) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+    if (so_init(10, 0) < 0) {
+        fprintf(stderr, "so_init failed\n");
+        return -1;
+    }
+    busy = with_spinner;
+    done = 0;
+    unsigned long long start = now_ns();
+    so_fork(driver, 1);
+    so_end();
+    unsigned long long elapsed = now_ns() - start;
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("bench=fd busy=%d rounds=%u roundtrip_ns=%.1f\n",
+           busy, no_rounds, (double)elapsed / no_rounds);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    no_rounds = argc > 1 ? atoi(argv[1]) : 20000;
+
+    if (run(0) < 0 || run(1) < 0) {
+        return 1;
+    }
+    return 0;
+}
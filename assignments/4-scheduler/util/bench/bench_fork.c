@@ -0,0 +1,49 @@
+// Fork throughput of short handlers with and without the worker pool.
+// Children run at a higher priority than the forking task, so each one
+// preempts it, finishes and, being detached, leaves its worker free for
+// the next fork.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+static unsigned int no_forks;
+
+static void child(unsigned int priority) {
+    (void)priority;
+}
+
+static void parent(unsigned int priority) {
+    for (unsigned int i = 0; i < no_forks; ++i) {
+        so_fork(child, priority + 1);
+    }
+}
+
+static int run(const char* name, unsigned int pool_size) {
+    so_opts_t opts = {0};
+    opts.pool_size = pool_size;
+    opts.detach = 1;
+
+    if (so_init_ex(1000, 0, &opts) < 0) {
+        fprintf(stderr, "so_init_ex failed\n");
+        return -1;
+    }
+    unsigned long long start = now_ns();
+    so_fork(parent, 0);
+    so_end();
+    unsigned long long elapsed = now_ns() - start;
+
+    printf("bench=fork mode=%s forks=%u fork_ns=%.1f forks_per_sec=%.0f\n",
+           name, no_forks, (double)elapsed / no_forks,
+           no_forks * 1e9 / elapsed);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    no_forks = argc > 1 ? atoi(argv[1]) : 10000;
+
+    if (run("thread", 0) < 0 || run("pool", 16) < 0) {
+        return 1;
+    }
+    return 0;
+}
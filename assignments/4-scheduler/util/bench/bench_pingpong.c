@@ -0,0 +1,53 @@
+// so_wait/so_signal round trip between two tasks of the same priority.
+// The ponger waits on device 0 and answers on device 1, the pinger does
+// the opposite. The quantum is large enough that neither task is
+// preempted between its signal and its wait.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+#define PING 0
+#define PONG 1
+
+static unsigned int no_rounds;
+
+static void ponger(unsigned int priority) {
+    (void)priority;
+    for (unsigned int i = 0; i < no_rounds; ++i) {
+        so_wait(PING);
+        so_signal(PONG);
+    }
+}
+
+static void pinger(unsigned int priority) {
+    (void)priority;
+    for (unsigned int i = 0; i < no_rounds; ++i) {
+        so_signal(PING);
+        so_wait(PONG);
+    }
+}
+
+static void driver(unsigned int priority) {
+    // each fork preempts the driver, so the ponger is already waiting
+    // when the pinger sends the first signal
+    so_fork(ponger, priority + 1);
+    so_fork(pinger, priority + 1);
+}
+
+int main(int argc, char** argv) {
+    no_rounds = argc > 1 ? atoi(argv[1]) : 20000;
+
+    if (so_init(1000, 2) < 0) {
+        fprintf(stderr, "so_init failed\n");
+        return 1;
+    }
+    unsigned long long start = now_ns();
+    so_fork(driver, 0);
+    so_end();
+    unsigned long long elapsed = now_ns() - start;
+
+    printf("bench=pingpong rounds=%u roundtrip_ns=%.1f\n",
+           no_rounds, (double)elapsed / no_rounds);
+    return 0;
+}
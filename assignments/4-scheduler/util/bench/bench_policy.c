@@ -0,0 +1,79 @@
+// Throughput and worst wait of the scheduling policies on CPU bound
+// tasks spread over all the priorities. A task measures its own waits:
+// the time from the start of the run to its first instruction and the
+// time every so_exec kept it off the CPU.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+#define TASKS_PER_PRIO 10
+#define EXECS_PER_TASK 200
+
+static unsigned long long start;
+static unsigned long long max_wait[SO_MAX_PRIO + 1];
+
+static void note_wait(unsigned int priority, unsigned long long wait) {
+    // tasks of the thread backend run one at a time, even on their own
+    // kernel threads, so the maximum needs no lock
+    if (wait > max_wait[priority]) {
+        max_wait[priority] = wait;
+    }
+}
+
+static void worker(unsigned int priority) {
+    unsigned long long last = now_ns();
+    note_wait(priority, last - start);
+
+    for (int i = 0; i < EXECS_PER_TASK; ++i) {
+        so_exec();
+        unsigned long long now = now_ns();
+        note_wait(priority, now - last);
+        last = now;
+    }
+}
+
+static void master(unsigned int priority) {
+    for (unsigned int i = 0; i < TASKS_PER_PRIO * (SO_MAX_PRIO + 1); ++i) {
+        so_fork(worker, i % (priority + 1));
+    }
+}
+
+static int run(const char* name, unsigned int policy) {
+    so_opts_t opts = {0};
+    opts.policy = policy;
+
+    for (int i = 0; i <= SO_MAX_PRIO; ++i) {
+        max_wait[i] = 0;
+    }
+    if (so_init_ex(4, 0, &opts) < 0) {
+        fprintf(stderr, "so_init_ex failed\n");
+        return -1;
+    }
+    start = now_ns();
+    so_fork(master, SO_MAX_PRIO);
+    so_end();
+    unsigned long long elapsed = now_ns() - start;
+
+    unsigned long long worst = 0;
+    for (int i = 0; i <= SO_MAX_PRIO; ++i) {
+        if (max_wait[i] > worst) {
+            worst = max_wait[i];
+        }
+    }
+    unsigned long long ops = (unsigned long long)TASKS_PER_PRIO * (SO_MAX_PRIO + 1) *
+                             EXECS_PER_TASK;
+    printf("bench=policy policy=%s tasks=%u op_ns=%.1f max_wait_ns=%llu "
+           "low_prio_max_wait_ns=%llu high_prio_max_wait_ns=%llu\n",
+           name, TASKS_PER_PRIO * (SO_MAX_PRIO + 1), (double)elapsed / ops,
+           worst, max_wait[0], max_wait[SO_MAX_PRIO]);
+    return 0;
+}
+
+int main(void) {
+    if (run("prio", SO_POLICY_PRIO) < 0 || run("mlfq", SO_POLICY_MLFQ) < 0 ||
+        run("fair", SO_POLICY_FAIR) < 0) {
+        return 1;
+    }
+    return 0;
+}
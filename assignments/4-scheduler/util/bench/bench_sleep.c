@@ -0,0 +1,78 @@
+// Cost of so_sleep while other tasks sleep much longer. A task sleeps for
+// one unit over and over, every time the CPU goes idle and the clock
+// skips to its wakeup; the timer wheel keeps the cost of that the same
+// however many sleepers wait behind it. The sleepers wake between 2^18
+// and 2^32 units later, spread over the upper levels of the wheel.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+// the tasks barely use their stacks, small ones let tens of thousands
+// of sleepers fit in memory
+#define STACK_SIZE (64 * 1024)
+
+static unsigned int no_sleeps;
+static unsigned int no_sleepers;
+static unsigned int no_forked;
+static unsigned long long elapsed;
+
+static void sleeper(unsigned int priority) {
+    (void)priority;
+    so_sleep((1U << (18 + rand() % 14)) + rand() % 4096);
+}
+
+static void napper(unsigned int priority) {
+    (void)priority;
+    unsigned long long start = now_ns();
+    for (unsigned int i = 0; i < no_sleeps; ++i) {
+        so_sleep(1);
+    }
+    elapsed = now_ns() - start;
+}
+
+static void master(unsigned int priority) {
+    for (unsigned int i = 0; i < no_sleepers; ++i) {
+        no_forked += so_fork(sleeper, priority) != INVALID_TID;
+    }
+    so_fork(napper, priority);
+}
+
+static int run(unsigned int sleepers) {
+    so_opts_t opts = {0};
+    opts.stack_size = STACK_SIZE;
+
+    no_sleepers = sleepers;
+    no_forked = 0;
+    if (so_init_ex(1000, 0, &opts) < 0) {
+        fprintf(stderr, "so_init_ex failed\n");
+        return -1;
+    }
+    so_fork(master, SO_MAX_PRIO);
+    so_end();
+
+    // every stack and its guard page are two mappings, and each task of
+    // the thread backend a kernel thread; vm.max_map_count and the
+    // thread limits cap the sleepers
+    if (no_forked < sleepers) {
+        fprintf(stderr, "bench_sleep: only %u of %u sleepers forked, skipped\n",
+                no_forked, sleepers);
+        return 0;
+    }
+    printf("bench=sleep sleepers=%u sleeps=%u sleep_ns=%.1f\n",
+           sleepers, no_sleeps, (double)elapsed / no_sleeps);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    no_sleeps = argc > 1 ? atoi(argv[1]) : 100000;
+
+    unsigned int counts[] = {0, 100, 2000, 10000, 50000};
+
+    for (unsigned int i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        if (run(counts[i]) < 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Tasks that fit in a 32-bit address space with the default stacks and
+// with 64 KB stacks, enough for most handlers. The address space is capped
+// at 3 GB, every task forked waits for an io device until forking fails
+// or max_tasks is reached; fork_ns is the cost of one of those forks.
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+#define ADDRESS_SPACE (3ULL << 30)
+
+static unsigned int max_tasks;
+static unsigned int no_tasks;
+static unsigned long long elapsed;
+
+static void waiter(unsigned int priority) {
+    (void)priority;
+    so_wait(0);
+}
+
+static void spawner(unsigned int priority) {
+    unsigned long long start = now_ns();
+    for (no_tasks = 0; no_tasks < max_tasks; ++no_tasks) {
+        if (so_fork(waiter, priority + 1) == INVALID_TID) {
+            break;
+        }
+    }
+    elapsed = now_ns() - start;
+    so_signal(0);
+}
+
+static int run(unsigned long stack_size) {
+    so_opts_t opts = {0};
+    opts.stack_size = stack_size;
+    opts.detach = 1;
+
+    if (so_init_ex(1000, 1, &opts) < 0) {
+        fprintf(stderr, "so_init_ex failed\n");
+        return -1;
+    }
+    so_fork(spawner, 0);
+    so_end();
+
+    printf("bench=stack stack_kb=%lu max_tasks=%u tasks=%u fork_ns=%.1f\n",
+           stack_size / 1024, max_tasks, no_tasks,
+           no_tasks != 0 ? (double)elapsed / no_tasks : 0.0);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    max_tasks = argc > 1 ? atoi(argv[1]) : 5000;
+
+    struct rlimit limit = { ADDRESS_SPACE, ADDRESS_SPACE };
+    if (setrlimit(RLIMIT_AS, &limit) < 0) {
+        perror("setrlimit");
+        return 1;
+    }
+
+    if (run(8 << 20) < 0 || run(64 << 10) < 0) {
+        return 1;
+    }
+    return 0;
+}
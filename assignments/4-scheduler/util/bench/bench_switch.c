@@ -0,0 +1,52 @@
+// Context switch latency as the number of parked tasks grows.
+// Every task runs with quantum 1, so each so_exec hands the CPU to the
+// next task of the same priority.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+#define EXECS_PER_TASK 200
+
+static unsigned int no_tasks;
+
+static void worker(unsigned int priority) {
+    (void)priority;
+    for (int i = 0; i < EXECS_PER_TASK; ++i) {
+        so_exec();
+    }
+}
+
+static void master(unsigned int priority) {
+    // fork at a higher priority so no worker runs before all are created
+    for (unsigned int i = 0; i < no_tasks; ++i) {
+        so_fork(worker, priority - 1);
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned int counts[] = {2, 8, 32, 128, 512};
+    unsigned int max_tasks = argc > 1 ? atoi(argv[1]) : 512;
+
+    for (unsigned int i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        if (counts[i] > max_tasks) {
+            break;
+        }
+        no_tasks = counts[i];
+
+        if (so_init(1, 0) < 0) {
+            fprintf(stderr, "so_init failed\n");
+            return 1;
+        }
+        unsigned long long start = now_ns();
+        so_fork(master, 1);
+        so_end();
+        unsigned long long elapsed = now_ns() - start;
+
+        unsigned long long switches = (unsigned long long)no_tasks * EXECS_PER_TASK;
+        printf("bench=switch tasks=%u switches=%llu switch_ns=%.1f\n",
+               no_tasks, switches, (double)elapsed / switches);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Scheduler throughput with many tasks spread over all the priorities.
+// A master at the highest priority forks the tasks, the ones below it
+// only run once it is done, then each task executes a fixed number of
+// instructions.
+#include <stdio.h>
+#include <stdlib.h>
+#include "so_scheduler.h"
+#include "bench.h"
+
+#define EXECS_PER_TASK 20
+
+static unsigned int no_tasks;
+
+static void worker(unsigned int priority) {
+    (void)priority;
+    for (int i = 0; i < EXECS_PER_TASK; ++i) {
+        so_exec();
+    }
+}
+
+static void master(unsigned int priority) {
+    for (unsigned int i = 0; i < no_tasks; ++i) {
+        so_fork(worker, i % (priority + 1));
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned int counts[] = {10, 100, 1000, 10000};
+    unsigned int max_tasks = argc > 1 ? atoi(argv[1]) : 10000;
+
+    for (unsigned int i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        if (counts[i] > max_tasks) {
+            break;
+        }
+        no_tasks = counts[i];
+
+        if (so_init(4, 0) < 0) {
+            fprintf(stderr, "so_init failed\n");
+            return 1;
+        }
+        unsigned long long start = now_ns();
+        so_fork(master, SO_MAX_PRIO);
+        so_end();
+        unsigned long long elapsed = now_ns() - start;
+
+        unsigned long long ops = (unsigned long long)no_tasks * EXECS_PER_TASK;
+        printf("bench=throughput tasks=%u execs=%llu op_ns=%.1f tasks_per_sec=%.0f\n",
+               no_tasks, ops, (double)elapsed / ops, no_tasks * 1e9 / elapsed);
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Compares two outputs of make bench and prints every measurement with the
+# percentage it got worse by, negative when it improved. Thread backend
+# numbers move by 10-20% between runs, hence the default threshold of 25.
+# usage: compare.sh old.txt new.txt [threshold]
+# exits with 1 when a regression is found
+old=$1
+new=$2
+threshold=${3:-25}
+
+if [ ! -f "$old" ] || [ ! -f "$new" ]; then
+    echo "usage: $0 old.txt new.txt [threshold]" >&2
+    exit 2
+fi
+
+awk -v threshold="$threshold" '
+# the identifying keys of a line, every key except the measurements
+function run_key(    i, key) {
+    key = ""
+    for (i = 1; i <= NF; ++i) {
+        if ($i !~ /_ns=/ && $i !~ /_per_sec=/) {
+            key = key " " $i
+        }
+    }
+    return key
+}
+
+/^bench=/ {
+    key = run_key()
+    for (i = 1; i <= NF; ++i) {
+        split($i, kv, "=")
+        if ($i ~ /_ns=/ || $i ~ /_per_sec=/) {
+            if (FNR == NR) {
+                base[key SUBSEP kv[1]] = kv[2]
+                continue
+            }
+            if (!((key SUBSEP kv[1]) in base) || base[key SUBSEP kv[1]] == 0) {
+                continue
+            }
+            old = base[key SUBSEP kv[1]]
+            # time goes up, rates go down when something regresses
+            change = (kv[2] - old) * 100 / old
+            if ($i ~ /_per_sec=/) {
+                change = -change
+            }
+            status = change > threshold ? "REGRESSION" : "ok"
+            if (status != "ok") {
+                failed = 1
+            }
+            printf "%-10s%s %s: %s -> %s (%+.1f%%)\n", status, key, kv[1], old, kv[2], change
+        }
+    }
+}
+
+END { exit failed }
+' "$old" "$new"
@@ -0,0 +1,92 @@
+// Every wait registers its descriptor once, with EPOLLONESHOT, and the
+// descriptor is removed again before its thread is woken, so the same
+// thread can wait for it again right away. A descriptor is waited for by
+// one thread at a time, epoll refuses to add it twice.
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "fd_poller.h"
+
+// events taken by one epoll_wait call
+#define POLL_BATCH 64
+
+int fd_poller_init(fd_poller* p)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+    p->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (p->epfd < 0) {
+        return -1;
+    }
+    p->stopfd = eventfd(0, EFD_CLOEXEC);
+    if (p->stopfd < 0 || epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->stopfd, &ev) < 0) {
+        fd_poller_destroy(p);
+        return -1;
+    }
+    return 0;
+}
+
+// tr waits until fd has one of events, see fd_poller_wait
+int fd_poller_add(fd_poller* p, thread* tr, int fd, unsigned int events)
+{
+    struct epoll_event ev = { .events = events | EPOLLONESHOT, .data.ptr = tr };
+
+    tr->wait_fd = fd;
+    return epoll_ctl(p->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// calls ready for every thread whose descriptor is ready, waiting at most
+// timeout_ms for the first one, -1 waits forever
+// returns the threads made ready or -1 once fd_poller_stop was called
+int fd_poller_wait(fd_poller* p, int timeout_ms, fd_ready_fn ready, void* arg)
+{
+    struct epoll_event events[POLL_BATCH];
+    int n = epoll_wait(p->epfd, events, POLL_BATCH, timeout_ms);
+    int woken = 0;
+
+    for (int i = 0; i < n; ++i) {
+        thread* tr = events[i].data.ptr;
+        if (tr == NULL) {
+            return -1;
+        }
+        epoll_ctl(p->epfd, EPOLL_CTL_DEL, tr->wait_fd, NULL);
+        ready(arg, tr, events[i].events);
+        ++woken;
+    }
+    return woken;
+}
+
+static void* poller_thread(void* arg)
+{
+    fd_poller* p = arg;
+
+    while (fd_poller_wait(p, -1, p->ready, p->arg) >= 0) {
+    }
+    return NULL;
+}
+
+// ready runs on the poller thread
+int fd_poller_start(fd_poller* p, fd_ready_fn ready, void* arg)
+{
+    p->ready = ready;
+    p->arg = arg;
+    return pthread_create(&p->thread, NULL, poller_thread, p) != 0 ? -1 : 0;
+}
+
+void fd_poller_stop(fd_poller* p)
+{
+    uint64_t one = 1;
+
+    if (write(p->stopfd, &one, sizeof(one)) == sizeof(one)) {
+        pthread_join(p->thread, NULL);
+    }
+}
+
+void fd_poller_destroy(fd_poller* p)
+{
+    if (p->stopfd >= 0) {
+        close(p->stopfd);
+    }
+    close(p->epfd);
+}
@@ -0,0 +1,32 @@
+#ifndef FD_POLLER_H
+#define FD_POLLER_H
+#include <pthread.h>
+#include "types.h"
+
+// Threads waiting for file descriptors, on top of an epoll instance. The
+// thread backend runs a poller thread that blocks in fd_poller_wait, the
+// green one polls from its main thread.
+typedef void (*fd_ready_fn)(void* arg, thread* tr, unsigned int events);
+
+typedef struct fd_poller {
+    int epfd;
+    // written by fd_poller_stop to wake the poller thread
+    int stopfd;
+    pthread_t thread;
+    fd_ready_fn ready;
+    void* arg;
+} fd_poller;
+
+int fd_poller_init(fd_poller* p);
+
+int fd_poller_add(fd_poller* p, thread* tr, int fd, unsigned int events);
+
+int fd_poller_wait(fd_poller* p, int timeout_ms, fd_ready_fn ready, void* arg);
+
+int fd_poller_start(fd_poller* p, fd_ready_fn ready, void* arg);
+
+void fd_poller_stop(fd_poller* p);
+
+void fd_poller_destroy(fd_poller* p);
+
+#endif
@@ -0,0 +1,97 @@
+// Weighted fair queuing in the spirit of CFS. Every scheduler call adds
+// to the virtual runtime of a thread in inverse proportion to the weight
+// of its priority, and the ready thread with the smallest virtual runtime
+// runs next, so each priority gets a share of the CPU instead of all of
+// it. The ready threads of a CPU are kept in a red-black tree.
+#include "types.h"
+#include "sched_policy.h"
+
+// one step of the weight table of the Linux nice levels per priority
+static const unsigned int fair_weights[SO_MAX_PRIO + 1] = {
+    335, 423, 526, 655, 820, 1024
+};
+
+#define FAIR_SCALE (1U << 20)
+
+// a thread this far behind the running one preempts it
+static unsigned long long granularity(scheduler* sch) {
+    return (unsigned long long)sch->time_quantum * (FAIR_SCALE / fair_weights[SO_MAX_PRIO]);
+}
+
+static unsigned long long vruntime(const thread* tr) {
+    return __atomic_load_n(&tr->vruntime, __ATOMIC_RELAXED);
+}
+
+static int fair_less(const rb_node* a, const rb_node* b) {
+    return rb_entry(a, thread, run_node)->vruntime < rb_entry(b, thread, run_node)->vruntime;
+}
+
+// a new thread starts level with the ones already running
+static void fair_fork(scheduler* sch, vcpu* cpu, thread* tr) {
+    (void)sch;
+    tr->level = tr->priority;
+    tr->vruntime = cpu->min_vruntime;
+}
+
+// a thread back from waiting gets at most one granularity of credit
+static void fair_enqueue(scheduler* sch, vcpu* cpu, thread* tr) {
+    unsigned long long gran = granularity(sch);
+    unsigned long long floor = cpu->min_vruntime > gran ? cpu->min_vruntime - gran : 0;
+
+    if (tr->vruntime < floor) {
+        tr->vruntime = floor;
+    }
+    rb_insert(&cpu->fair_queue, &tr->run_node, fair_less);
+}
+
+static thread* fair_dequeue(scheduler* sch, vcpu* cpu) {
+    (void)sch;
+    rb_node* first = rb_first(&cpu->fair_queue);
+    if (first == NULL) {
+        return NULL;
+    }
+
+    rb_erase(&cpu->fair_queue, first);
+    thread* tr = rb_entry(first, thread, run_node);
+    if (tr->vruntime > cpu->min_vruntime) {
+        cpu->min_vruntime = tr->vruntime;
+    }
+    return tr;
+}
+
+// min_vruntime only follows the leftmost thread
+static void fair_remove(scheduler* sch, vcpu* cpu, thread* tr) {
+    (void)sch;
+    rb_erase(&cpu->fair_queue, &tr->run_node);
+}
+
+static int fair_preempts(scheduler* sch, vcpu* cpu, thread* curr) {
+    rb_node* first = rb_first(&cpu->fair_queue);
+    if (first == NULL) {
+        return 0;
+    }
+    return rb_entry(first, thread, run_node)->vruntime + granularity(sch) < vruntime(curr);
+}
+
+static int fair_urgency(vcpu* cpu) {
+    return rb_first(&cpu->fair_queue) != NULL ? 0 : -1;
+}
+
+// only the running thread advances its own virtual runtime
+static void fair_charge(scheduler* sch, thread* tr) {
+    (void)sch;
+    __atomic_store_n(&tr->vruntime, tr->vruntime + FAIR_SCALE / fair_weights[tr->priority],
+                     __ATOMIC_RELAXED);
+}
+
+const sched_policy policy_fair = {
+    .fork = fair_fork,
+    .enqueue = fair_enqueue,
+    .dequeue = fair_dequeue,
+    .remove = fair_remove,
+    .preempts = fair_preempts,
+    .urgency = fair_urgency,
+    .charge = fair_charge,
+    .expired = NULL,
+    .tick = NULL,
+};
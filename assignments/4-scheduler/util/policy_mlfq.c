@@ -0,0 +1,77 @@
+// Multi-level feedback queue: a thread starts on the level of its
+// priority and drops one level every time it uses up its whole quantum,
+// so CPU bound threads sink below the ones that block often. Aging moves
+// a ready thread one level up for every MLFQ_AGE_QUANTA quanta it waits,
+// which bounds how long a low priority thread can starve.
+#include "types.h"
+#include "task_queue.h"
+#include "sched_policy.h"
+#include "sched_clock.h"
+
+#define MLFQ_AGE_QUANTA 4
+
+// instructions run on cpu, or nanoseconds with a wall clock quantum
+static unsigned long long cpu_clock(scheduler* sch, vcpu* cpu) {
+    if (sch->slice_ns != 0) {
+        return now_ns();
+    }
+
+    unsigned long long clock = 0;
+    for (int i = 0; i <= SO_MAX_PRIO; ++i) {
+        clock += __atomic_load_n(&cpu->instructions[i], __ATOMIC_RELAXED);
+    }
+    return clock;
+}
+
+static void mlfq_fork(scheduler* sch, vcpu* cpu, thread* tr) {
+    (void)sch;
+    (void)cpu;
+    tr->level = tr->priority;
+}
+
+static void mlfq_expired(scheduler* sch, thread* tr) {
+    (void)sch;
+    if (tr->level > 0) {
+        --tr->level;
+    }
+}
+
+static void mlfq_enqueue(scheduler* sch, vcpu* cpu, thread* tr) {
+    tr->aged_at = cpu_clock(sch, cpu);
+    level_enqueue(sch, cpu, tr);
+}
+
+// the oldest thread of each level moves one level up once it waited for
+// MLFQ_AGE_QUANTA quanta, so waiting threads climb past the ones that
+// keep using up their quantum
+static void mlfq_tick(scheduler* sch, vcpu* cpu) {
+    unsigned long long age = MLFQ_AGE_QUANTA *
+        (sch->slice_ns != 0 ? sch->slice_ns : sch->time_quantum);
+    unsigned long long now = cpu_clock(sch, cpu);
+
+    for (int level = SO_MAX_PRIO - 1; level >= 0; --level) {
+        T_Queue* queue = &cpu->ready_queues[level];
+        thread* tr;
+
+        while ((tr = front(queue)) != NULL && now - tr->aged_at >= age) {
+            dequeue(queue);
+            if (is_empty(queue)) {
+                prio_clear(&cpu->ready_mask, level);
+            }
+            tr->level = level + 1;
+            mlfq_enqueue(sch, cpu, tr);
+        }
+    }
+}
+
+const sched_policy policy_mlfq = {
+    .fork = mlfq_fork,
+    .enqueue = mlfq_enqueue,
+    .dequeue = level_dequeue,
+    .remove = level_remove,
+    .preempts = level_preempts,
+    .urgency = level_urgency,
+    .charge = NULL,
+    .expired = mlfq_expired,
+    .tick = mlfq_tick,
+};
@@ -0,0 +1,60 @@
+// Strict priority round robin: a thread always waits on the level of its
+// priority and the highest non empty level runs first.
+#include "types.h"
+#include "task_queue.h"
+#include "sched_policy.h"
+
+void level_enqueue(scheduler* sch, vcpu* cpu, thread* tr) {
+    (void)sch;
+    enqueue(&cpu->ready_queues[tr->level], tr);
+    prio_set(&cpu->ready_mask, tr->level);
+}
+
+thread* level_dequeue(scheduler* sch, vcpu* cpu) {
+    (void)sch;
+    int level = prio_highest(&cpu->ready_mask);
+    if (level < 0) {
+        return NULL;
+    }
+
+    thread* tr = dequeue(&cpu->ready_queues[level]);
+    if (is_empty(&cpu->ready_queues[level])) {
+        prio_clear(&cpu->ready_mask, level);
+    }
+    return tr;
+}
+
+void level_remove(scheduler* sch, vcpu* cpu, thread* tr) {
+    (void)sch;
+    remove_from_queue(&cpu->ready_queues[tr->level], tr);
+    if (is_empty(&cpu->ready_queues[tr->level])) {
+        prio_clear(&cpu->ready_mask, tr->level);
+    }
+}
+
+int level_preempts(scheduler* sch, vcpu* cpu, thread* curr) {
+    (void)sch;
+    return prio_highest(&cpu->ready_mask) > (int)curr->level;
+}
+
+int level_urgency(vcpu* cpu) {
+    return prio_highest(&cpu->ready_mask);
+}
+
+static void prio_fork(scheduler* sch, vcpu* cpu, thread* tr) {
+    (void)sch;
+    (void)cpu;
+    tr->level = tr->priority;
+}
+
+const sched_policy policy_prio = {
+    .fork = prio_fork,
+    .enqueue = level_enqueue,
+    .dequeue = level_dequeue,
+    .remove = level_remove,
+    .preempts = level_preempts,
+    .urgency = level_urgency,
+    .charge = NULL,
+    .expired = NULL,
+    .tick = NULL,
+};
@@ -0,0 +1,38 @@
+#ifndef PRIO_BITMAP_H
+#define PRIO_BITMAP_H
+
+#include <limits.h>
+#include "so_scheduler.h"
+
+// one bit for each priority level, set while that level has ready threads
+// written under the scheduler lock, the so_exec fast path reads it without
+// taking the lock, so every access is a single relaxed load or store
+#define PRIO_WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define PRIO_WORDS ((SO_MAX_PRIO + PRIO_WORD_BITS) / PRIO_WORD_BITS)
+
+typedef struct prio_bitmap {
+    unsigned long words[PRIO_WORDS];
+} prio_bitmap;
+
+static inline void prio_set(prio_bitmap* map, unsigned int prio) {
+    unsigned long* word = &map->words[prio / PRIO_WORD_BITS];
+    __atomic_store_n(word, *word | 1UL << (prio % PRIO_WORD_BITS), __ATOMIC_RELAXED);
+}
+
+static inline void prio_clear(prio_bitmap* map, unsigned int prio) {
+    unsigned long* word = &map->words[prio / PRIO_WORD_BITS];
+    __atomic_store_n(word, *word & ~(1UL << (prio % PRIO_WORD_BITS)), __ATOMIC_RELAXED);
+}
+
+// returns the highest priority with its bit set or -1 if the map is empty
+static inline int prio_highest(const prio_bitmap* map) {
+    for (int i = PRIO_WORDS - 1; i >= 0; --i) {
+        unsigned long word = __atomic_load_n(&map->words[i], __ATOMIC_RELAXED);
+        if (word != 0) {
+            return i * PRIO_WORD_BITS + PRIO_WORD_BITS - 1 - __builtin_clzl(word);
+        }
+    }
+    return -1;
+}
+
+#endif
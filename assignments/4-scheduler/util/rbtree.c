@@ -0,0 +1,263 @@
+// red-black tree from CLRS, with NULL leaves and parent links
+#include "rbtree.h"
+
+static void rotate_left(rb_root* tree, rb_node* x)
+{
+    rb_node* y = x->right;
+
+    x->right = y->left;
+    if (y->left != NULL) {
+        y->left->parent = x;
+    }
+    y->parent = x->parent;
+    if (x->parent == NULL) {
+        tree->root = y;
+    }
+    else if (x == x->parent->left) {
+        x->parent->left = y;
+    }
+    else {
+        x->parent->right = y;
+    }
+    y->left = x;
+    x->parent = y;
+}
+
+static void rotate_right(rb_root* tree, rb_node* x)
+{
+    rb_node* y = x->left;
+
+    x->left = y->right;
+    if (y->right != NULL) {
+        y->right->parent = x;
+    }
+    y->parent = x->parent;
+    if (x->parent == NULL) {
+        tree->root = y;
+    }
+    else if (x == x->parent->right) {
+        x->parent->right = y;
+    }
+    else {
+        x->parent->left = y;
+    }
+    y->right = x;
+    x->parent = y;
+}
+
+static int is_red(const rb_node* node)
+{
+    return node != NULL && node->red;
+}
+
+static rb_node* minimum(rb_node* node)
+{
+    while (node->left != NULL) {
+        node = node->left;
+    }
+    return node;
+}
+
+static rb_node* next(rb_node* node)
+{
+    if (node->right != NULL) {
+        return minimum(node->right);
+    }
+    while (node->parent != NULL && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+void rb_insert(rb_root* tree, rb_node* node,
+               int (*less)(const rb_node* a, const rb_node* b))
+{
+    rb_node** link = &tree->root;
+    rb_node* parent = NULL;
+    int leftmost = 1;
+
+    while (*link != NULL) {
+        parent = *link;
+        if (less(node, parent)) {
+            link = &parent->left;
+        }
+        else {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->red = 1;
+    *link = node;
+    if (leftmost) {
+        tree->leftmost = node;
+    }
+
+    rb_node* p;
+    while ((p = node->parent) != NULL && p->red) {
+        // a red node is never the root, so the grandparent exists
+        rb_node* g = p->parent;
+        if (p == g->left) {
+            rb_node* uncle = g->right;
+            if (is_red(uncle)) {
+                p->red = 0;
+                uncle->red = 0;
+                g->red = 1;
+                node = g;
+                continue;
+            }
+            if (node == p->right) {
+                rotate_left(tree, p);
+                node = p;
+                p = node->parent;
+            }
+            p->red = 0;
+            g->red = 1;
+            rotate_right(tree, g);
+        }
+        else {
+            rb_node* uncle = g->left;
+            if (is_red(uncle)) {
+                p->red = 0;
+                uncle->red = 0;
+                g->red = 1;
+                node = g;
+                continue;
+            }
+            if (node == p->left) {
+                rotate_right(tree, p);
+                node = p;
+                p = node->parent;
+            }
+            p->red = 0;
+            g->red = 1;
+            rotate_left(tree, g);
+        }
+    }
+    tree->root->red = 0;
+}
+
+static void transplant(rb_root* tree, rb_node* u, rb_node* v)
+{
+    if (u->parent == NULL) {
+        tree->root = v;
+    }
+    else if (u == u->parent->left) {
+        u->parent->left = v;
+    }
+    else {
+        u->parent->right = v;
+    }
+    if (v != NULL) {
+        v->parent = u->parent;
+    }
+}
+
+// x took the place of a removed black node, parent is its parent since
+// x may be a NULL leaf
+static void erase_fixup(rb_root* tree, rb_node* x, rb_node* parent)
+{
+    while (x != tree->root && !is_red(x)) {
+        if (x == parent->left) {
+            rb_node* w = parent->right;
+            if (w->red) {
+                w->red = 0;
+                parent->red = 1;
+                rotate_left(tree, parent);
+                w = parent->right;
+            }
+            if (!is_red(w->left) && !is_red(w->right)) {
+                w->red = 1;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (!is_red(w->right)) {
+                w->left->red = 0;
+                w->red = 1;
+                rotate_right(tree, w);
+                w = parent->right;
+            }
+            w->red = parent->red;
+            parent->red = 0;
+            w->right->red = 0;
+            rotate_left(tree, parent);
+        }
+        else {
+            rb_node* w = parent->left;
+            if (w->red) {
+                w->red = 0;
+                parent->red = 1;
+                rotate_right(tree, parent);
+                w = parent->left;
+            }
+            if (!is_red(w->left) && !is_red(w->right)) {
+                w->red = 1;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (!is_red(w->left)) {
+                w->right->red = 0;
+                w->red = 1;
+                rotate_left(tree, w);
+                w = parent->left;
+            }
+            w->red = parent->red;
+            parent->red = 0;
+            w->left->red = 0;
+            rotate_right(tree, parent);
+        }
+        x = tree->root;
+        break;
+    }
+    if (x != NULL) {
+        x->red = 0;
+    }
+}
+
+void rb_erase(rb_root* tree, rb_node* node)
+{
+    rb_node* x;
+    rb_node* parent;
+    int removed_red = node->red;
+
+    if (tree->leftmost == node) {
+        tree->leftmost = next(node);
+    }
+
+    if (node->left == NULL) {
+        x = node->right;
+        parent = node->parent;
+        transplant(tree, node, node->right);
+    }
+    else if (node->right == NULL) {
+        x = node->left;
+        parent = node->parent;
+        transplant(tree, node, node->left);
+    }
+    else {
+        rb_node* y = minimum(node->right);
+        removed_red = y->red;
+        x = y->right;
+        if (y->parent == node) {
+            parent = y;
+        }
+        else {
+            parent = y->parent;
+            transplant(tree, y, y->right);
+            y->right = node->right;
+            y->right->parent = y;
+        }
+        transplant(tree, node, y);
+        y->left = node->left;
+        y->left->parent = y;
+        y->red = node->red;
+    }
+
+    if (!removed_red) {
+        erase_fixup(tree, x, parent);
+    }
+}
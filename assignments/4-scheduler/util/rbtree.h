@@ -0,0 +1,32 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+#include <stddef.h>
+
+// Intrusive red-black tree, the nodes live inside the ordered structures
+// and rb_entry gets back to them. The leftmost node is cached.
+typedef struct rb_node {
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    int red;
+} rb_node;
+
+typedef struct rb_root {
+    rb_node* root;
+    rb_node* leftmost;
+} rb_root;
+
+#define rb_entry(node, type, member) \
+    ((type*)((char*)(node) - offsetof(type, member)))
+
+// equal keys are inserted after the existing ones
+void rb_insert(rb_root* tree, rb_node* node,
+               int (*less)(const rb_node* a, const rb_node* b));
+
+void rb_erase(rb_root* tree, rb_node* node);
+
+static inline rb_node* rb_first(const rb_root* tree) {
+    return tree->leftmost;
+}
+
+#endif
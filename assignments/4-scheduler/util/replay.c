@@ -0,0 +1,233 @@
+// Record and replay of the scheduling decisions. Record mode logs every
+// switch of a CPU with the number of scheduler calls the thread giving it
+// up had made, so replay mode can repeat it at the same call no matter
+// how the timers, the other kernel threads or the wall clock quantum
+// behave this time. Each CPU follows its own records, so a schedule with
+// a single CPU repeats exactly.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "replay.h"
+
+#define REPLAY_MAGIC "SORP"
+#define REPLAY_VERSION 1
+
+typedef struct replay_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t ncpus;
+    uint32_t reserved;
+} replay_header;
+
+static replay_log* replay_new(unsigned int ncpus) {
+    replay_log* log = calloc(1, sizeof(*log));
+    if (log == NULL) {
+        return NULL;
+    }
+    log->ncpus = ncpus;
+    return log;
+}
+
+replay_log* replay_record(const char* path, unsigned int ncpus) {
+    replay_log* log = replay_new(ncpus);
+    if (log == NULL) {
+        return NULL;
+    }
+
+    log->path = strdup(path);
+    if (log->path == NULL) {
+        replay_destroy(log);
+        return NULL;
+    }
+    return log;
+}
+
+// first record of cpu with the given type at or after i
+static unsigned long find(replay_log* log, unsigned long i, unsigned int cpu, unsigned int type) {
+    while (i < log->no_recs && (log->recs[i].cpu != cpu || log->recs[i].type != type)) {
+        ++i;
+    }
+    return i;
+}
+
+replay_log* replay_load(const char* path, unsigned int ncpus) {
+    replay_header hdr;
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    replay_log* log = replay_new(ncpus);
+    if (log == NULL || fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, REPLAY_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != REPLAY_VERSION || hdr.ncpus != ncpus) {
+        goto fail;
+    }
+
+    replay_rec rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (log->no_recs == log->cap) {
+            unsigned long cap = log->cap != 0 ? 2 * log->cap : 1024;
+            replay_rec* recs = realloc(log->recs, cap * sizeof(replay_rec));
+            if (recs == NULL) {
+                goto fail;
+            }
+            log->recs = recs;
+            log->cap = cap;
+        }
+        log->recs[log->no_recs++] = rec;
+    }
+
+    log->next_switch = calloc(ncpus, sizeof(unsigned long));
+    log->next_signal = calloc(ncpus, sizeof(unsigned long));
+    if (log->next_switch == NULL || log->next_signal == NULL) {
+        goto fail;
+    }
+    for (unsigned int i = 0; i < ncpus; ++i) {
+        log->next_switch[i] = find(log, 0, i, REPLAY_SWITCH);
+        log->next_signal[i] = find(log, 0, i, REPLAY_SIGNAL);
+    }
+    log->replaying = 1;
+    fclose(f);
+    return log;
+
+fail:
+    fclose(f);
+    replay_destroy(log);
+    return NULL;
+}
+
+static int write_log(replay_log* log) {
+    replay_header hdr = { .version = REPLAY_VERSION, .ncpus = log->ncpus };
+    FILE* f = fopen(log->path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+
+    memcpy(hdr.magic, REPLAY_MAGIC, sizeof(hdr.magic));
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(log->recs, sizeof(replay_rec), log->no_recs, f) != log->no_recs) {
+        fclose(f);
+        return -1;
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+// a recording is written here, a log cut short by a failed allocation
+// still replays up to where it stops
+void replay_destroy(replay_log* log) {
+    if (log == NULL) {
+        return;
+    }
+    if (!log->replaying && log->path != NULL) {
+        write_log(log);
+    }
+    free(log->recs);
+    free(log->path);
+    free(log->next_switch);
+    free(log->next_signal);
+    free(log->by_id);
+    free(log);
+}
+
+// makes tr known by its fork order
+// returns 0 on success or -1 if there is no memory
+int replay_fork(replay_log* log, thread* tr) {
+    if (tr->id >= log->no_ids) {
+        unsigned long no_ids = log->no_ids != 0 ? log->no_ids : 64;
+        while (no_ids <= tr->id) {
+            no_ids *= 2;
+        }
+        thread** by_id = realloc(log->by_id, no_ids * sizeof(thread*));
+        if (by_id == NULL) {
+            return -1;
+        }
+        memset(by_id + log->no_ids, 0, (no_ids - log->no_ids) * sizeof(thread*));
+        log->by_id = by_id;
+        log->no_ids = no_ids;
+    }
+    log->by_id[tr->id] = tr;
+    return 0;
+}
+
+// NULL once the thread finished
+thread* replay_thread(replay_log* log, unsigned int id) {
+    return id < log->no_ids ? log->by_id[id] : NULL;
+}
+
+// the control block of a finished thread may be reused by another fork
+// before that one gets its id
+void replay_exit(replay_log* log, const thread* tr) {
+    if (tr->id < log->no_ids && log->by_id[tr->id] == tr) {
+        log->by_id[tr->id] = NULL;
+    }
+}
+
+static void append(replay_log* log, const replay_rec* rec) {
+    if (log->no_recs == log->cap) {
+        unsigned long cap = log->cap != 0 ? 2 * log->cap : 1024;
+        replay_rec* recs = realloc(log->recs, cap * sizeof(replay_rec));
+        if (recs == NULL) {
+            return;
+        }
+        log->recs = recs;
+        log->cap = cap;
+    }
+    log->recs[log->no_recs++] = *rec;
+}
+
+// record mode: prev gave cpu to next, NULL stands for an idle CPU
+void replay_switch(replay_log* log, unsigned int cpu, const thread* prev,
+                   const thread* next, unsigned int flags) {
+    replay_rec rec = {
+        .type = REPLAY_SWITCH,
+        .cpu = cpu,
+        .arg = flags,
+        .task = replay_id(prev),
+        .at = replay_at(prev),
+        .next = replay_id(next),
+    };
+    append(log, &rec);
+}
+
+// logs a signal while recording, compares it with the recorded one while
+// replaying: signals are not forced, a different one is only counted
+void replay_signal(replay_log* log, unsigned int cpu, const thread* tr,
+                   unsigned int io, unsigned int woken) {
+    replay_rec rec = {
+        .type = REPLAY_SIGNAL,
+        .cpu = cpu,
+        .arg = io,
+        .task = replay_id(tr),
+        .at = replay_at(tr),
+        .next = woken,
+    };
+
+    if (!log->replaying) {
+        append(log, &rec);
+        return;
+    }
+
+    unsigned long i = log->next_signal[cpu];
+    if (i >= log->no_recs) {
+        ++log->misses;
+        return;
+    }
+    const replay_rec* want = &log->recs[i];
+    if (want->arg != rec.arg || want->task != rec.task || want->next != rec.next) {
+        ++log->misses;
+    }
+    log->next_signal[cpu] = find(log, i + 1, cpu, REPLAY_SIGNAL);
+}
+
+// replay mode: the next switch recorded for cpu, NULL once all were done
+const replay_rec* replay_next(replay_log* log, unsigned int cpu) {
+    unsigned long i = log->next_switch[cpu];
+    return i < log->no_recs ? &log->recs[i] : NULL;
+}
+
+void replay_consume(replay_log* log, unsigned int cpu) {
+    unsigned long i = find(log, log->next_switch[cpu] + 1, cpu, REPLAY_SWITCH);
+    __atomic_store_n(&log->next_switch[cpu], i, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,88 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include "types.h"
+
+// record types
+#define REPLAY_SWITCH 0
+#define REPLAY_SIGNAL 1
+
+// flags of a switch: the quantum of the thread giving up the CPU expired,
+// or its handler returned after its last scheduler call
+#define REPLAY_EXPIRED 1
+#define REPLAY_EXITED 2
+
+// one decision: task, running on cpu after at scheduler calls of its own,
+// gave the CPU to next, arg holds the flags; or task sent a signal of
+// device arg that woke next threads
+typedef struct replay_rec {
+    uint8_t type;
+    uint8_t cpu;
+    uint16_t arg;
+    uint32_t task;
+    uint32_t at;
+    uint32_t next;
+} replay_rec;
+
+// SO_RECORD=<file> logs the decisions and writes them in so_end,
+// SO_REPLAY=<file> loads such a log and repeats it
+struct replay_log {
+    replay_rec* recs;
+    unsigned long no_recs;
+    unsigned long cap;
+    unsigned int ncpus;
+    int replaying;
+    // record mode: written by replay_destroy
+    char* path;
+    // replay mode: next switch and signal record of each CPU
+    unsigned long* next_switch;
+    unsigned long* next_signal;
+    // threads by fork order, the records name them by id
+    thread** by_id;
+    unsigned long no_ids;
+    // recorded decisions that could not be repeated
+    unsigned long long misses;
+};
+
+replay_log* replay_record(const char* path, unsigned int ncpus);
+
+replay_log* replay_load(const char* path, unsigned int ncpus);
+
+void replay_destroy(replay_log* log);
+
+int replay_fork(replay_log* log, thread* tr);
+
+thread* replay_thread(replay_log* log, unsigned int id);
+
+void replay_exit(replay_log* log, const thread* tr);
+
+void replay_switch(replay_log* log, unsigned int cpu, const thread* prev,
+                   const thread* next, unsigned int flags);
+
+void replay_signal(replay_log* log, unsigned int cpu, const thread* tr,
+                   unsigned int io, unsigned int woken);
+
+const replay_rec* replay_next(replay_log* log, unsigned int cpu);
+
+void replay_consume(replay_log* log, unsigned int cpu);
+
+// id and scheduler calls of the thread a record names, 0 for an idle CPU
+static inline unsigned int replay_id(const thread* tr) {
+    return tr != NULL ? tr->id : 0;
+}
+
+static inline uint32_t replay_at(const thread* tr) {
+    return tr != NULL ? (uint32_t)tr->stats.instructions : 0;
+}
+
+// replay mode: the next scheduler call of tr, running on cpu, reaches its
+// recorded switch and cannot take the lock free path
+static inline int replay_due(replay_log* log, unsigned int cpu, const thread* tr) {
+    unsigned long i = __atomic_load_n(&log->next_switch[cpu], __ATOMIC_RELAXED);
+
+    return i < log->no_recs && log->recs[i].task == tr->id &&
+           log->recs[i].at == replay_at(tr) + 1 && !(log->recs[i].arg & REPLAY_EXITED);
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef SCHED_CLOCK_H
+#define SCHED_CLOCK_H
+
+#include <time.h>
+
+// monotonic time in nanoseconds, served by the vDSO on Linux
+static inline unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,881 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "types.h"
+#include "task_queue.h"
+#include "sched_core.h"
+#include "trace.h"
+#include "replay.h"
+#include "task_table.h"
+#include "sched_clock.h"
+#include "sched_policy.h"
+#include "sched_deadline.h"
+#include "timer_wheel.h"
+#include "tcb_slab.h"
+#include "task_stack.h"
+
+// wait_io of a sleeping thread, it waits for no device
+#define NO_IO UINT_MAX
+
+static thread* steal(scheduler* sch, unsigned int cpu);
+static void balance(scheduler* sch);
+static unsigned long long sched_now(scheduler* sch);
+
+int sched_init(scheduler* sch, unsigned int time_quantum, unsigned int io,
+               const so_opts_t* opts, thread* main_thread) {
+    unsigned int ncpus = opts != NULL && opts->ncpus != 0 ? opts->ncpus : 1;
+    if (ncpus > SO_MAX_CPUS) {
+        return -1;
+    }
+    unsigned int slice = opts != NULL ? opts->slice : SO_SLICE_CALLS;
+    if (slice != SO_SLICE_CALLS && slice != SO_SLICE_US) {
+        return -1;
+    }
+    static const sched_policy* const policies[] = {
+        [SO_POLICY_PRIO] = &policy_prio,
+        [SO_POLICY_MLFQ] = &policy_mlfq,
+        [SO_POLICY_FAIR] = &policy_fair,
+    };
+    unsigned int policy = opts != NULL ? opts->policy : SO_POLICY_PRIO;
+    if (policy >= sizeof(policies) / sizeof(policies[0])) {
+        return -1;
+    }
+    sch->policy = policies[policy];
+
+    // SO_TRACE=<file> turns tracing on and writes the trace in so_end
+    const char* trace_path = getenv("SO_TRACE");
+    unsigned int trace_events = opts != NULL ? opts->trace_events : 0;
+    if (trace_events != 0 || trace_path != NULL) {
+        sch->trace = trace_create(trace_events != 0 ? trace_events : TRACE_DEFAULT_EVENTS,
+                                  trace_path);
+        if (sch->trace == NULL) {
+            return -1;
+        }
+    }
+
+    // SO_RECORD=<file> logs the scheduling decisions for so_end to write,
+    // SO_REPLAY=<file> repeats the ones of an earlier run
+    const char* record_path = getenv("SO_RECORD");
+    const char* replay_path = getenv("SO_REPLAY");
+    if (replay_path != NULL) {
+        sch->replay = replay_load(replay_path, ncpus);
+    }
+    else if (record_path != NULL) {
+        sch->replay = replay_record(record_path, ncpus);
+    }
+
+    // io can be 0, keep at least one element so calloc never returns NULL
+    sch->devices = calloc(io + 1, sizeof(io_device));
+    sch->cpus = calloc(ncpus, sizeof(vcpu));
+    if (sch->devices == NULL || sch->cpus == NULL || table_init(&sch->tasks) < 0 ||
+        ((replay_path != NULL || record_path != NULL) && sch->replay == NULL)) {
+        sched_destroy(sch);
+        return -1;
+    }
+
+    sch->time_quantum = time_quantum;
+    sch->slice_ns = slice == SO_SLICE_US ? time_quantum * 1000ULL : 0;
+    sch->async_preempt = sch->slice_ns != 0 && opts->async_preempt != 0;
+    sch->io = io;
+    sch->ncpus = ncpus;
+    sch->stats_on = opts != NULL && opts->stats != 0;
+    sch->detach_all = opts != NULL && opts->detach != 0;
+    sch->stack_size = stack_size(opts);
+    // no of all created threads
+    sch->no_threads = 0;
+    init_queue(&sch->terminated_threads);
+    init_queue(&sch->idle_workers);
+    init_queue(&sch->exited_workers);
+
+    for (unsigned int i = 0; i < ncpus; ++i) {
+        for (int j = 0; j <= SO_MAX_PRIO; ++j) {
+            init_queue(&sch->cpus[i].ready_queues[j]);
+        }
+        init_queue(&sch->cpus[i].throttled);
+    }
+    wheel_init(&sch->timers, sched_now(sch));
+
+    // the main thread runs on the first CPU until the first fork
+    sch->main_thread = main_thread;
+    main_thread->owner = sch;
+    sch->main_thread_running = 1;
+    main_thread->cpu = 0;
+    sch->cpus[0].running = main_thread;
+    sch->idle_cpus = ncpus - 1;
+
+    for (unsigned int i = 0; i < io; ++i) {
+        for (int j = 0; j <= SO_MAX_PRIO; ++j) {
+            init_queue(&sch->devices[i].waiters[j]);
+        }
+        sch->devices[i].mode = SO_IO_BROADCAST;
+    }
+
+    return 0;
+}
+
+void sched_destroy(scheduler* sch) {
+    if (sch->trace != NULL && sch->trace->path != NULL) {
+        trace_dump(sch->trace, sch->trace->path);
+    }
+    trace_destroy(sch->trace);
+    sch->trace = NULL;
+    replay_destroy(sch->replay);
+    sch->replay = NULL;
+    free(sch->devices);
+    sch->devices = NULL;
+    free(sch->cpus);
+    sch->cpus = NULL;
+    table_destroy(&sch->tasks);
+    tcb_slab_destroy(&sch->tcbs);
+    free(sch->stacks);
+    sch->stacks = NULL;
+}
+
+// numbers a new thread and queues it on its CPU
+void sched_fork(scheduler* sch, thread* tr) {
+    tr->id = ++sch->no_threads;
+    tr->owner = sch;
+    // a reused thread may come back with a different tid
+    table_remove(&sch->tasks, tr);
+    table_insert(&sch->tasks, tr);
+    memset(&tr->stats, 0, sizeof(tr->stats));
+    ++sch->stats.forks;
+    trace(sch, TRACE_FORK, tr->cpu, tr, tr->priority);
+    if (sch->replay != NULL) {
+        replay_fork(sch->replay, tr);
+    }
+    if (tr->edf) {
+        tr->level = tr->priority;
+        edf_fork(sch, tr);
+    }
+    else {
+        sch->policy->fork(sch, &sch->cpus[tr->cpu], tr);
+    }
+    ready_push(sch, tr);
+}
+
+// deadline threads go first, the policy orders the others
+static int should_preempt(scheduler* sch, vcpu* cpu, thread* curr) {
+    return edf_preempts(cpu, curr) || (!curr->edf && sch->policy->preempts(sch, cpu, curr));
+}
+
+// queues tr on the CPU it last ran on and flags the running thread of
+// that CPU if tr should take its place
+void ready_push(scheduler* sch, thread* tr) {
+    vcpu* cpu = &sch->cpus[tr->cpu];
+    thread* running = cpu->running;
+
+    if (tr->edf) {
+        edf_enqueue(sch, cpu, tr);
+    }
+    else {
+        sch->policy->enqueue(sch, cpu, tr);
+    }
+    if (running != NULL && running != sch->main_thread && should_preempt(sch, cpu, running)) {
+        __atomic_store_n(&cpu->need_resched, 1, __ATOMIC_RELAXED);
+    }
+    if (sch->stats_on) {
+        tr->ready_since = now_ns();
+    }
+}
+
+// bucket i of the latency histogram holds values below 2^i ns
+static unsigned int latency_bucket(unsigned long long ns) {
+    unsigned int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    return b < SO_STATS_BUCKETS ? b : SO_STATS_BUCKETS - 1;
+}
+
+static void account_run(scheduler* sch, thread* tr) {
+    so_prio_stats_t* ps = &sch->stats.prio[tr->priority];
+
+    ++sch->stats.switches;
+    ++tr->stats.runs;
+    ++ps->runs;
+    if (tr->ready_since == 0) {
+        return;
+    }
+
+    unsigned long long latency = now_ns() - tr->ready_since;
+    tr->ready_since = 0;
+    tr->stats.ready_ns += latency;
+    if (latency > tr->stats.max_latency_ns) {
+        tr->stats.max_latency_ns = latency;
+    }
+    ps->ready_ns += latency;
+    ++ps->latency_hist[latency_bucket(latency)];
+}
+
+static void account_preemption(scheduler* sch, thread* tr) {
+    ++tr->stats.preemptions;
+    ++sch->stats.prio[tr->priority].preemptions;
+    ++sch->stats.preemptions;
+}
+
+// makes tr the running thread of cpu, NULL leaves the CPU idle
+void sched_dispatch(scheduler* sch, unsigned int cpu, thread* tr) {
+    vcpu* c = &sch->cpus[cpu];
+
+    if (c->running == NULL && tr != NULL) {
+        --sch->idle_cpus;
+    }
+    else if (c->running != NULL && tr == NULL) {
+        ++sch->idle_cpus;
+    }
+    c->running = tr;
+
+    if (tr == NULL) {
+        trace(sch, TRACE_IDLE, cpu, NULL, 0);
+        return;
+    }
+    trace(sch, TRACE_RUN, cpu, tr, tr->priority);
+    account_run(sch, tr);
+    tr->cpu = cpu;
+    tr->time_quantum = sch->time_quantum;
+    __atomic_store_n(&c->need_resched, 0, __ATOMIC_RELAXED);
+    if (sch->slice_ns != 0) {
+        c->slice_end = now_ns() + sch->slice_ns;
+        __atomic_store_n(&c->slice_expired, 0, __ATOMIC_RELAXED);
+    }
+    if (tr->edf) {
+        edf_dispatch(sch, c, tr);
+    }
+    if (sch->wake != NULL) {
+        sch->wake(tr);
+    }
+}
+
+// counters read by so_get_stats while the running thread updates them
+static inline void count(unsigned long long* counter) {
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+// the quantum of the thread running on c is used up
+static int slice_over(scheduler* sch, vcpu* c) {
+    if (sch->slice_ns != 0) {
+        return __atomic_load_n(&c->slice_expired, __ATOMIC_RELAXED);
+    }
+    return c->running->time_quantum == 0;
+}
+
+// every scheduler call costs the calling thread one unit of its quantum
+void sched_charge(scheduler* sch, thread* tr) {
+    --tr->time_quantum;
+    count(&tr->stats.instructions);
+    count(&sch->cpus[tr->cpu].instructions[tr->priority]);
+    if (sch->policy->charge != NULL && !tr->edf) {
+        sch->policy->charge(sch, tr);
+    }
+}
+
+// charges the running thread tr without the scheduler lock when the call
+// cannot switch threads: its quantum does not expire and no thread that
+// should preempt it was queued on its CPU. Only tr changes its own
+// quantum, a thread queued while the flag is read is seen by the next
+// locked call.
+// returns 0 when the caller has to go through sched_charge and sched_pick
+int sched_charge_fast(scheduler* sch, thread* tr) {
+    vcpu* c = &sch->cpus[tr->cpu];
+
+    if (tr == sch->main_thread) {
+        return 0;
+    }
+    if (sch->slice_ns != 0 ? __atomic_load_n(&c->slice_expired, __ATOMIC_RELAXED)
+                           : tr->time_quantum <= 1) {
+        return 0;
+    }
+    if (__atomic_load_n(&c->need_resched, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    if (sch->replay != NULL && sch->replay->replaying && replay_due(sch->replay, tr->cpu, tr)) {
+        return 0;
+    }
+
+    sched_charge(sch, tr);
+    return 1;
+}
+
+// called by the slice timer, marks the quantum of the thread running on
+// cpu as used up once its time passed; a replay ignores the wall clock
+// returns 1 when the quantum expired with this tick
+int sched_tick(scheduler* sch, unsigned int cpu, unsigned long long now) {
+    vcpu* c = &sch->cpus[cpu];
+
+    if ((sch->replay != NULL && sch->replay->replaying) || c->running == NULL || c->running == sch->main_thread ||
+        __atomic_load_n(&c->slice_expired, __ATOMIC_RELAXED) || now < c->slice_end) {
+        return 0;
+    }
+    __atomic_store_n(&c->slice_expired, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// takes the most urgent ready thread queued on another CPU, the earliest
+// deadline if there is one
+static thread* steal(scheduler* sch, unsigned int cpu) {
+    vcpu* victim = NULL;
+    int best = -1;
+
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        rb_node* first = rb_first(&sch->cpus[i].edf_queue);
+        if (i != cpu && first != NULL &&
+            (victim == NULL || rb_entry(first, thread, run_node)->deadline <
+                               rb_entry(rb_first(&victim->edf_queue), thread, run_node)->deadline)) {
+            victim = &sch->cpus[i];
+        }
+    }
+    if (victim != NULL) {
+        return edf_dequeue(victim);
+    }
+
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        int urgency = sch->policy->urgency(&sch->cpus[i]);
+        if (i != cpu && urgency > best) {
+            best = urgency;
+            victim = &sch->cpus[i];
+        }
+    }
+
+    if (victim == NULL) {
+        return NULL;
+    }
+    return sch->policy->dequeue(sch, victim);
+}
+
+// idle CPUs take work from the busy ones
+static void balance(scheduler* sch) {
+    for (unsigned int i = 0; i < sch->ncpus && sch->idle_cpus > 0; ++i) {
+        if (sch->cpus[i].running != NULL) {
+            continue;
+        }
+
+        thread* tr = steal(sch, i);
+        if (tr == NULL) {
+            return;
+        }
+        sched_dispatch(sch, i, tr);
+    }
+}
+
+// time of so_sleep and so_wait_timeout in the units of the quantum:
+// microseconds, or the scheduler calls made on all the CPUs plus the ones
+// skipped while every task slept
+static unsigned long long sched_now(scheduler* sch) {
+    if (sch->slice_ns != 0) {
+        return now_ns() / 1000;
+    }
+
+    unsigned long long clock = sch->clock_skip;
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        for (int j = 0; j <= SO_MAX_PRIO; ++j) {
+            clock += __atomic_load_n(&sch->cpus[i].instructions[j], __ATOMIC_RELAXED);
+        }
+    }
+    return clock;
+}
+
+// tr stops waiting for an io device or sleeping and becomes ready, unless
+// it never left its CPU
+static void end_wait(scheduler* sch, thread* tr) {
+    tr->waiting = 0;
+    if (tr->edf) {
+        edf_wake(sch, tr);
+    }
+    if (tr->wait_since != 0) {
+        unsigned long long waited = now_ns() - tr->wait_since;
+        tr->stats.wait_ns += waited;
+        if (tr->wait_io != NO_IO) {
+            sch->stats.io_wait_ns[tr->wait_io] += waited;
+        }
+        tr->wait_since = 0;
+    }
+    if (sch->cpus[tr->cpu].running != tr) {
+        ready_push(sch, tr);
+    }
+}
+
+// the time of tr came before any signal of the device it waits for
+static void timer_expired(void* arg, thread* tr) {
+    scheduler* sch = arg;
+
+    if (tr->wait_io != NO_IO) {
+        io_device* dev = &sch->devices[tr->wait_io];
+        remove_from_queue(&dev->waiters[tr->priority], tr);
+        if (is_empty(&dev->waiters[tr->priority])) {
+            prio_clear(&dev->waiting_mask, tr->priority);
+        }
+    }
+    tr->timed_out = 1;
+    trace(sch, TRACE_TIMEOUT, tr->cpu, tr, tr->wait_io);
+    end_wait(sch, tr);
+}
+
+static unsigned int expire_timers(scheduler* sch) {
+    return wheel_advance(&sch->timers, sched_now(sch), timer_expired, sch);
+}
+
+// with scheduler call time the clock stands still while no task runs, so
+// the last CPU to go idle moves it to the next timeout; a main thread that
+// runs while the tasks are idle does that itself, see sched_timer_delay
+static thread* skip_to_timer(scheduler* sch, unsigned int cpu) {
+    vcpu* c = &sch->cpus[cpu];
+    unsigned long long ns;
+
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        thread* running = sch->cpus[i].running;
+        if (i != cpu && running != NULL && running != sch->main_thread) {
+            return NULL;
+        }
+    }
+
+    while (sched_timer_delay(sch, &ns)) {
+        if (expire_timers(sch) > 0) {
+            break;
+        }
+    }
+
+    thread* next = edf_dequeue(c);
+    if (next == NULL) {
+        next = sch->policy->dequeue(sch, c);
+    }
+    if (next == NULL) {
+        next = steal(sch, cpu);
+    }
+    return next;
+}
+
+// a thread a replay runs next leaves the ready queues of its CPU
+// returns 0 when tr is not ready
+static int take_ready(scheduler* sch, thread* tr) {
+    vcpu* c = &sch->cpus[tr->cpu];
+
+    if (tr->waiting || tr->work_done || c->running == tr) {
+        return 0;
+    }
+    if (tr->edf) {
+        // out of budget, it waits in the throttled queue
+        if (tr->runtime == 0) {
+            return 0;
+        }
+        rb_erase(&c->edf_queue, &tr->run_node);
+        return 1;
+    }
+    sch->policy->remove(sch, c, tr);
+    return 1;
+}
+
+enum replay_decision {
+    // no record fits, the policy decides
+    REPLAY_POLICY,
+    // the running thread keeps the CPU until its recorded switch
+    REPLAY_HOLD,
+    // the recorded switch, to *forced
+    REPLAY_FORCE,
+    // same, the quantum of the running thread expired in the recording
+    REPLAY_EXPIRE,
+};
+
+// replay mode: repeats the next switch recorded for cpu once its running
+// thread made as many scheduler calls as in the recording
+static int replay_decide(scheduler* sch, unsigned int cpu, int main_running, thread** forced) {
+    thread* curr = sch->cpus[cpu].running;
+    const replay_rec* rec = replay_next(sch->replay, cpu);
+    int runnable = curr != NULL && !main_running && !curr->work_done && !curr->waiting &&
+                   !(curr->edf && curr->runtime == 0);
+    // the last scheduler call and the exit of a thread share the count
+    int exited = curr != NULL && !main_running && curr->work_done;
+
+    if (rec == NULL || rec->task != replay_id(curr) || rec->at > replay_at(curr) ||
+        !(rec->arg & REPLAY_EXITED) != !exited) {
+        if (runnable) {
+            return REPLAY_HOLD;
+        }
+        ++sch->replay->misses;
+        return REPLAY_POLICY;
+    }
+    // the thread got past its switch, e.g. a lock free call missed it
+    if (rec->at < replay_at(curr)) {
+        ++sch->replay->misses;
+    }
+
+    replay_consume(sch->replay, cpu);
+    // the recording went idle or back to the main thread
+    if (rec->next == 0) {
+        return REPLAY_POLICY;
+    }
+    *forced = replay_thread(sch->replay, rec->next);
+    if (*forced == NULL || !take_ready(sch, *forced)) {
+        *forced = NULL;
+        ++sch->replay->misses;
+        return REPLAY_POLICY;
+    }
+    return rec->arg & REPLAY_EXPIRED ? REPLAY_EXPIRE : REPLAY_FORCE;
+}
+
+// chooses the thread that runs next on cpu, an idle CPU steals from the
+// others and the new running thread is woken through sch->wake; a replay
+// chooses the recorded one instead
+void sched_pick(scheduler* sch, unsigned int cpu) {
+    vcpu* c = &sch->cpus[cpu];
+    thread* curr = c->running;
+    int main_running = curr == sch->main_thread && sch->main_thread_running == 1;
+    thread* prev = curr;
+    unsigned int flags = 0;
+
+    if (sch->timers.no_elem != 0) {
+        expire_timers(sch);
+    }
+    if (sch->policy->tick != NULL) {
+        sch->policy->tick(sch, c);
+    }
+    if (sch->edf_util != 0) {
+        edf_replenish(sch, c);
+    }
+    if (curr != NULL && curr->edf) {
+        edf_account(sch, curr);
+    }
+
+    int replay = REPLAY_POLICY;
+    thread* forced = NULL;
+    if (sch->replay != NULL && sch->replay->replaying) {
+        replay = replay_decide(sch, cpu, main_running, &forced);
+    }
+    // a held thread whose quantum is over gets a new one, as when the
+    // policy picks it again
+    if (replay == REPLAY_HOLD && slice_over(sch, c)) {
+        trace(sch, TRACE_QUANTUM, cpu, curr, 0);
+        account_preemption(sch, curr);
+        if (sch->policy->expired != NULL && !curr->edf) {
+            sch->policy->expired(sch, curr);
+        }
+        sched_dispatch(sch, cpu, curr);
+    }
+
+    if (curr != NULL && !main_running &&
+        ((replay == REPLAY_POLICY && slice_over(sch, c)) || replay == REPLAY_EXPIRE ||
+         (curr->edf && curr->runtime == 0) || curr->work_done == 1 || curr->waiting == 1)) {
+        if (curr->work_done == 1) {
+            flags = REPLAY_EXITED;
+            trace(sch, TRACE_EXIT, cpu, curr, 0);
+            if (sch->replay != NULL) {
+                replay_exit(sch->replay, curr);
+            }
+            if (curr->joiner != NULL && curr->joiner->joining == curr) {
+                curr->joiner->joining = NULL;
+                end_wait(sch, curr->joiner);
+            }
+            if (curr->edf) {
+                edf_release(sch, curr->period, curr->budget);
+                curr->edf = 0;
+            }
+        }
+        else if (curr->waiting == 0) {
+            flags = REPLAY_EXPIRED;
+            trace(sch, TRACE_QUANTUM, cpu, curr, 0);
+            account_preemption(sch, curr);
+            if (sch->policy->expired != NULL && !curr->edf) {
+                sch->policy->expired(sch, curr);
+            }
+            ready_push(sch, curr);
+        }
+        curr = NULL;
+    }
+
+    thread* next = forced;
+    if (forced != NULL) {
+        if (curr != NULL && !main_running) {
+            trace(sch, TRACE_PREEMPT, cpu, curr, next->id);
+            account_preemption(sch, curr);
+            ready_push(sch, curr);
+        }
+    }
+    else if (replay == REPLAY_HOLD) {
+        // the running thread goes on
+    }
+    else if (curr == NULL || main_running) {
+        next = edf_dequeue(c);
+        if (next == NULL) {
+            next = sch->policy->dequeue(sch, c);
+        }
+        if (next == NULL) {
+            next = steal(sch, cpu);
+        }
+        if (next == NULL) {
+            next = edf_idle(sch, c);
+        }
+    }
+    else if (should_preempt(sch, c, curr)) {
+        next = edf_dequeue(c);
+        if (next == NULL) {
+            next = sch->policy->dequeue(sch, c);
+        }
+        trace(sch, TRACE_PREEMPT, cpu, curr, next->id);
+        account_preemption(sch, curr);
+        ready_push(sch, curr);
+    }
+
+    if (next != NULL) {
+        sch->main_thread_running = 0;
+        sched_dispatch(sch, cpu, next);
+    }
+    else if (curr == NULL) {
+        sched_dispatch(sch, cpu, NULL);
+    }
+    // whoever runs now is the best choice of the policy
+    __atomic_store_n(&c->need_resched, 0, __ATOMIC_RELAXED);
+
+    if (c->running == NULL && sch->slice_ns == 0 && sch->timers.no_elem != 0 && !sch->main_idles) {
+        next = skip_to_timer(sch, cpu);
+        if (next != NULL) {
+            sch->main_thread_running = 0;
+            sched_dispatch(sch, cpu, next);
+        }
+    }
+
+    if (sch->replay != NULL && !sch->replay->replaying && c->running != prev) {
+        replay_switch(sch->replay, cpu, prev, c->running, flags);
+    }
+    balance(sch);
+}
+
+// a counting device lets tr through when a signal is pending
+// returns 1 if tr has to wait for the device and 0 otherwise
+int sched_wait(scheduler* sch, thread* tr, unsigned int io) {
+    io_device* dev = &sch->devices[io];
+
+    if (dev->mode == SO_IO_COUNTING && dev->count > 0) {
+        --dev->count;
+        return 0;
+    }
+
+    tr->waiting = 1;
+    trace(sch, TRACE_WAIT, tr->cpu, tr, io);
+    ++sch->stats.io_waits[io];
+    tr->wait_io = io;
+    tr->wait_since = sch->stats_on ? now_ns() : 0;
+    enqueue(&dev->waiters[tr->priority], tr);
+    prio_set(&dev->waiting_mask, tr->priority);
+    return 1;
+}
+
+// removes the highest priority thread waiting for dev
+thread* wait_pop(io_device* dev) {
+    int prio = prio_highest(&dev->waiting_mask);
+    if (prio < 0) {
+        return NULL;
+    }
+
+    thread* tr = dequeue(&dev->waiters[prio]);
+    if (is_empty(&dev->waiters[prio])) {
+        prio_clear(&dev->waiting_mask, prio);
+    }
+    return tr;
+}
+
+// moves up to n threads waiting for io to the ready queues of cpu, a
+// counting device keeps the signals nobody was waiting for
+int sched_signal_n(scheduler* sch, unsigned int io, unsigned int n, unsigned int cpu) {
+    io_device* dev = &sch->devices[io];
+    thread* tr = NULL;
+    int threads_signaled = 0;
+    trace(sch, TRACE_SIGNAL, cpu, sch->cpus[cpu].running, io);
+    while ((unsigned int)threads_signaled < n) {
+        tr = wait_pop(dev);
+        if (tr == NULL) {
+            break;
+        }
+        wheel_cancel(&sch->timers, tr);
+        tr->cpu = cpu;
+        trace(sch, TRACE_WAKE, cpu, tr, io);
+        ++threads_signaled;
+        end_wait(sch, tr);
+    }
+
+    if (dev->mode == SO_IO_COUNTING) {
+        unsigned int left = n - threads_signaled;
+        dev->count = left > UINT_MAX - dev->count ? UINT_MAX : dev->count + left;
+    }
+    if (sch->replay != NULL) {
+        replay_signal(sch->replay, cpu, sch->cpus[cpu].running, io, threads_signaled);
+    }
+    return threads_signaled;
+}
+
+// so_signal wakes every waiter, or a single one on a counting device
+int sched_signal(scheduler* sch, unsigned int io, unsigned int cpu) {
+    unsigned int n = sch->devices[io].mode == SO_IO_COUNTING ? 1 : UINT_MAX;
+    return sched_signal_n(sch, io, n, cpu);
+}
+
+// sched_wait that gives up after units time units, tr->timed_out tells
+// whether the signal or the timeout came first
+// returns 1 if tr has to wait and 0 otherwise
+int sched_wait_timeout(scheduler* sch, thread* tr, unsigned int io, unsigned int units) {
+    tr->timed_out = 0;
+    if (!sched_wait(sch, tr, io)) {
+        return 0;
+    }
+    if (units == 0) {
+        timer_expired(sch, tr);
+        return 0;
+    }
+    wheel_add(&sch->timers, tr, sched_now(sch) + units);
+    return 1;
+}
+
+// tr waits until target finishes, unless its handler already returned
+// returns 1 if tr has to wait and 0 otherwise
+int sched_join(scheduler* sch, thread* tr, thread* target) {
+    target->joiner = tr;
+    if (target->work_done) {
+        return 0;
+    }
+
+    tr->waiting = 1;
+    tr->joining = target;
+    trace(sch, TRACE_JOIN, tr->cpu, tr, target->id);
+    tr->wait_io = NO_IO;
+    tr->wait_since = sch->stats_on ? now_ns() : 0;
+    return 1;
+}
+
+// tr sleeps for units time units, see sched_now
+// returns 1 if tr has to give up the CPU and 0 if units is 0
+int sched_sleep(scheduler* sch, thread* tr, unsigned int units) {
+    if (units == 0) {
+        return 0;
+    }
+
+    tr->waiting = 1;
+    trace(sch, TRACE_SLEEP, tr->cpu, tr, units);
+    tr->wait_io = NO_IO;
+    tr->wait_since = sch->stats_on ? now_ns() : 0;
+    wheel_add(&sch->timers, tr, sched_now(sch) + units);
+    return 1;
+}
+
+// lets the idle CPUs pick up the threads made ready by a caller that
+// runs on none of them; a busy CPU switches at the next call of its
+// running thread, which need_resched sends through sched_pick
+void sched_fill_idle(scheduler* sch) {
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        if (sch->cpus[i].running == NULL) {
+            sched_pick(sch, i);
+        }
+    }
+}
+
+// wakes the threads whose time came, the slice timer calls this so they
+// do not wait for the next scheduler call and idle CPUs pick them up
+void sched_expire(scheduler* sch) {
+    if (sch->timers.no_elem == 0 || expire_timers(sch) == 0) {
+        return;
+    }
+    sched_fill_idle(sch);
+}
+
+// tr waits until the backend sees fd ready, see fd_poller.c
+void sched_wait_fd(scheduler* sch, thread* tr, int fd) {
+    tr->waiting = 1;
+    trace(sch, TRACE_WAIT_FD, tr->cpu, tr, fd);
+    tr->wait_io = NO_IO;
+    tr->wait_since = sch->stats_on ? now_ns() : 0;
+    ++sch->fd_waiters;
+}
+
+// the descriptor of tr is ready with events, an idle CPU picks tr up
+void sched_fd_ready(scheduler* sch, thread* tr, unsigned int events) {
+    --sch->fd_waiters;
+    tr->fd_events = events;
+    trace(sch, TRACE_FD_READY, tr->cpu, tr, tr->wait_fd);
+    end_wait(sch, tr);
+    sched_fill_idle(sch);
+}
+
+// how long a backend whose tasks all sleep has to wait for the next
+// timer, with scheduler call time the clock jumps there instead
+// returns 0 if no thread sleeps
+int sched_timer_delay(scheduler* sch, unsigned long long* ns) {
+    unsigned long long when;
+    if (!wheel_next(&sch->timers, &when)) {
+        return 0;
+    }
+
+    unsigned long long now = sched_now(sch);
+    *ns = 0;
+    if (when > now) {
+        if (sch->slice_ns != 0) {
+            *ns = (when - now) * 1000;
+        }
+        else {
+            sch->clock_skip += when - now;
+        }
+    }
+    return 1;
+}
+
+// switching back to broadcast drops the pending signals
+void sched_io_mode(scheduler* sch, unsigned int io, unsigned int mode) {
+    sch->devices[io].mode = mode;
+    sch->devices[io].count = 0;
+}
+
+void sched_stats(scheduler* sch, so_stats_t* stats) {
+    *stats = sch->stats;
+    stats->replay_misses = sch->replay != NULL ? sch->replay->misses : 0;
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        for (int j = 0; j <= SO_MAX_PRIO; ++j) {
+            stats->prio[j].instructions +=
+                __atomic_load_n(&sch->cpus[i].instructions[j], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int sched_task_stats(scheduler* sch, tid_t tid, so_task_stats_t* stats) {
+    thread* tr = table_find(&sch->tasks, tid);
+    if (tr == NULL) {
+        return -1;
+    }
+    *stats = tr->stats;
+    // a running task counts its instructions without the lock
+    stats->instructions = __atomic_load_n(&tr->stats.instructions, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// records the stack use of the finished task tr, see stack_peak
+void sched_stack_peak(scheduler* sch, thread* tr, unsigned long long bytes) {
+    tr->stats.stack_peak = bytes;
+
+    unsigned int i = 0;
+    while (i < sch->no_stacks && sch->stacks[i].func != tr->func) {
+        ++i;
+    }
+    if (i == sch->no_stacks) {
+        // the array doubles whenever its size is a power of two
+        if ((i & (i - 1)) == 0) {
+            handler_stack* stacks = realloc(sch->stacks, (i ? 2 * i : 1) * sizeof(*stacks));
+            if (stacks == NULL) {
+                return;
+            }
+            sch->stacks = stacks;
+        }
+        sch->stacks[i].func = tr->func;
+        sch->stacks[i].tasks = 0;
+        sch->stacks[i].peak = 0;
+        ++sch->no_stacks;
+    }
+    ++sch->stacks[i].tasks;
+    if (bytes > sch->stacks[i].peak) {
+        sch->stacks[i].peak = bytes;
+    }
+}
+
+int sched_stack_stats(scheduler* sch, so_handler* func, so_stack_stats_t* stats) {
+    for (unsigned int i = 0; i < sch->no_stacks; ++i) {
+        if (sch->stacks[i].func == func) {
+            stats->tasks = sch->stacks[i].tasks;
+            stats->peak = sch->stacks[i].peak;
+            stats->size = sch->stack_size;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,61 @@
+#ifndef SCHED_CORE_H
+#define SCHED_CORE_H
+#include "types.h"
+
+// Scheduling decisions shared by all the backends. Nothing here locks,
+// the backend serializes the calls (sch_mutex or a single kernel thread).
+
+int sched_init(scheduler* sch, unsigned int time_quantum, unsigned int io,
+               const so_opts_t* opts, thread* main_thread);
+
+void sched_destroy(scheduler* sch);
+
+void sched_fork(scheduler* sch, thread* tr);
+
+void ready_push(scheduler* sch, thread* tr);
+
+void sched_dispatch(scheduler* sch, unsigned int cpu, thread* tr);
+
+void sched_charge(scheduler* sch, thread* tr);
+
+int sched_charge_fast(scheduler* sch, thread* tr);
+
+int sched_tick(scheduler* sch, unsigned int cpu, unsigned long long now);
+
+void sched_pick(scheduler* sch, unsigned int cpu);
+
+void sched_fill_idle(scheduler* sch);
+
+int sched_wait(scheduler* sch, thread* tr, unsigned int io);
+
+int sched_wait_timeout(scheduler* sch, thread* tr, unsigned int io, unsigned int units);
+
+int sched_join(scheduler* sch, thread* tr, thread* target);
+
+int sched_sleep(scheduler* sch, thread* tr, unsigned int units);
+
+void sched_expire(scheduler* sch);
+
+void sched_wait_fd(scheduler* sch, thread* tr, int fd);
+
+void sched_fd_ready(scheduler* sch, thread* tr, unsigned int events);
+
+int sched_timer_delay(scheduler* sch, unsigned long long* ns);
+
+thread* wait_pop(io_device* dev);
+
+int sched_signal(scheduler* sch, unsigned int io, unsigned int cpu);
+
+int sched_signal_n(scheduler* sch, unsigned int io, unsigned int n, unsigned int cpu);
+
+void sched_io_mode(scheduler* sch, unsigned int io, unsigned int mode);
+
+void sched_stats(scheduler* sch, so_stats_t* stats);
+
+int sched_task_stats(scheduler* sch, tid_t tid, so_task_stats_t* stats);
+
+void sched_stack_peak(scheduler* sch, thread* tr, unsigned long long bytes);
+
+int sched_stack_stats(scheduler* sch, so_handler* func, so_stack_stats_t* stats);
+
+#endif
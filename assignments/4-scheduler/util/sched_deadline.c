@@ -0,0 +1,183 @@
+// Deadline tasks get budget time units every period units and must be
+// done, that is waiting for an io device, by the end of each period.
+// Ready ones are kept per CPU in a red-black tree by absolute deadline,
+// the ones that used up their budget wait on the throttled queue for
+// their next period. Time is the wall clock with SO_SLICE_US and the
+// number of scheduler calls made on all the CPUs otherwise.
+#include "types.h"
+#include "task_queue.h"
+#include "sched_deadline.h"
+#include "sched_clock.h"
+
+// utilization is kept in millionths of a CPU
+#define EDF_UNIT 1000000ULL
+
+static unsigned long long edf_now(scheduler* sch) {
+    if (sch->slice_ns != 0) {
+        return now_ns();
+    }
+
+    unsigned long long clock = 0;
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        for (int j = 0; j <= SO_MAX_PRIO; ++j) {
+            clock += __atomic_load_n(&sch->cpus[i].instructions[j], __ATOMIC_RELAXED);
+        }
+    }
+    return clock;
+}
+
+// time the running thread tr used since run_start
+static unsigned long long edf_used(scheduler* sch, thread* tr) {
+    if (sch->slice_ns != 0) {
+        return now_ns() - tr->run_start;
+    }
+    return __atomic_load_n(&tr->stats.instructions, __ATOMIC_RELAXED) - tr->run_start;
+}
+
+static unsigned long long edf_run_start(scheduler* sch, thread* tr) {
+    if (sch->slice_ns != 0) {
+        return now_ns();
+    }
+    return __atomic_load_n(&tr->stats.instructions, __ATOMIC_RELAXED);
+}
+
+static int edf_less(const rb_node* a, const rb_node* b) {
+    return rb_entry(a, thread, run_node)->deadline < rb_entry(b, thread, run_node)->deadline;
+}
+
+// period and budget are in quantum units, microseconds or calls
+static void new_period(scheduler* sch, thread* tr, unsigned long long now) {
+    unsigned long long scale = sch->slice_ns != 0 ? 1000 : 1;
+
+    tr->deadline = now + tr->period * scale;
+    tr->runtime = tr->budget * scale;
+}
+
+static unsigned long long utilization(unsigned int period, unsigned int budget) {
+    return budget * EDF_UNIT / period;
+}
+
+// reserves the share of the CPUs a new deadline task needs
+// returns 0 if the task fits or -1 otherwise
+int edf_admit(scheduler* sch, unsigned int period, unsigned int budget) {
+    if (budget == 0 || period < budget) {
+        return -1;
+    }
+
+    unsigned long long util = utilization(period, budget);
+    unsigned long long limit = sch->ncpus * EDF_UNIT * SO_DEADLINE_MAX_UTIL / 100;
+    if (sch->edf_util + util > limit) {
+        return -1;
+    }
+    sch->edf_util += util;
+    return 0;
+}
+
+// gives back the share of a task that exited or was never forked
+void edf_release(scheduler* sch, unsigned int period, unsigned int budget) {
+    sch->edf_util -= utilization(period, budget);
+}
+
+// the first period starts with the fork
+void edf_fork(scheduler* sch, thread* tr) {
+    new_period(sch, tr, edf_now(sch));
+}
+
+// a thread that waited past its deadline starts a new period on wakeup
+void edf_wake(scheduler* sch, thread* tr) {
+    unsigned long long now = edf_now(sch);
+
+    if (now >= tr->deadline) {
+        new_period(sch, tr, now);
+    }
+}
+
+// tr wants the CPU, if its period ended before it could wait again that
+// is a miss and it moves to the next period
+void edf_enqueue(scheduler* sch, vcpu* cpu, thread* tr) {
+    unsigned long long now = edf_now(sch);
+
+    if (now >= tr->deadline) {
+        ++tr->stats.deadline_misses;
+        ++sch->stats.deadline_misses;
+        new_period(sch, tr, now);
+    }
+
+    if (tr->runtime == 0) {
+        enqueue(&cpu->throttled, tr);
+        return;
+    }
+    rb_insert(&cpu->edf_queue, &tr->run_node, edf_less);
+}
+
+thread* edf_dequeue(vcpu* cpu) {
+    rb_node* first = rb_first(&cpu->edf_queue);
+    if (first == NULL) {
+        return NULL;
+    }
+
+    rb_erase(&cpu->edf_queue, first);
+    return rb_entry(first, thread, run_node);
+}
+
+// 1 if the earliest deadline ready on cpu comes before curr
+int edf_preempts(vcpu* cpu, thread* curr) {
+    rb_node* first = rb_first(&cpu->edf_queue);
+    if (first == NULL) {
+        return 0;
+    }
+    return !curr->edf || rb_entry(first, thread, run_node)->deadline < curr->deadline;
+}
+
+// charges the budget of the running deadline thread tr
+void edf_account(scheduler* sch, thread* tr) {
+    unsigned long long used = edf_used(sch, tr);
+
+    tr->runtime = used >= tr->runtime ? 0 : tr->runtime - used;
+    tr->run_start = edf_run_start(sch, tr);
+}
+
+// throttled threads become ready again when their period ends
+void edf_replenish(scheduler* sch, vcpu* cpu) {
+    unsigned long long now = edf_now(sch);
+    thread* tr = front(&cpu->throttled);
+
+    while (tr != NULL) {
+        thread* next = tr->next;
+        if (now >= tr->deadline) {
+            remove_from_queue(&cpu->throttled, tr);
+            edf_enqueue(sch, cpu, tr);
+        }
+        tr = next;
+    }
+}
+
+// a CPU with nothing else to run starts the next period of its earliest
+// throttled thread right away, returns NULL if none is throttled
+thread* edf_idle(scheduler* sch, vcpu* cpu) {
+    thread* best = NULL;
+
+    for (thread* tr = front(&cpu->throttled); tr != NULL; tr = tr->next) {
+        if (best == NULL || tr->deadline < best->deadline) {
+            best = tr;
+        }
+    }
+    if (best != NULL) {
+        remove_from_queue(&cpu->throttled, best);
+        new_period(sch, best, edf_now(sch));
+    }
+    return best;
+}
+
+// the quantum of a deadline thread never outlasts its budget
+void edf_dispatch(scheduler* sch, vcpu* cpu, thread* tr) {
+    tr->run_start = edf_run_start(sch, tr);
+    if (sch->slice_ns != 0) {
+        if (tr->runtime < sch->slice_ns) {
+            cpu->slice_end = now_ns() + tr->runtime;
+        }
+    }
+    else if (tr->runtime < tr->time_quantum) {
+        tr->time_quantum = tr->runtime;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef SCHED_DEADLINE_H
+#define SCHED_DEADLINE_H
+#include "types.h"
+
+// Earliest deadline first class of so_fork_deadline, scheduled ahead of
+// every policy. Like sched_core, nothing here locks.
+
+int edf_admit(scheduler* sch, unsigned int period, unsigned int budget);
+
+void edf_release(scheduler* sch, unsigned int period, unsigned int budget);
+
+void edf_fork(scheduler* sch, thread* tr);
+
+void edf_wake(scheduler* sch, thread* tr);
+
+void edf_enqueue(scheduler* sch, vcpu* cpu, thread* tr);
+
+thread* edf_dequeue(vcpu* cpu);
+
+int edf_preempts(vcpu* cpu, thread* curr);
+
+void edf_account(scheduler* sch, thread* tr);
+
+void edf_replenish(scheduler* sch, vcpu* cpu);
+
+thread* edf_idle(scheduler* sch, vcpu* cpu);
+
+void edf_dispatch(scheduler* sch, vcpu* cpu, thread* tr);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef SCHED_POLICY_H
+#define SCHED_POLICY_H
+#include "types.h"
+
+// Scheduling policy, chosen by so_opts_t.policy. The policy owns the
+// order of the ready threads of each CPU, sched_core owns the rest. All
+// the hooks run under the backend lock except charge, which the running
+// thread also calls from the lock free so_exec path and which may only
+// touch the fields of that thread.
+struct sched_policy {
+    // a new thread starts on cpu
+    void (*fork)(scheduler* sch, vcpu* cpu, thread* tr);
+    // tr becomes ready on cpu
+    void (*enqueue)(scheduler* sch, vcpu* cpu, thread* tr);
+    // removes the thread that runs next on cpu, NULL if none is ready
+    thread* (*dequeue)(scheduler* sch, vcpu* cpu);
+    // removes the ready thread tr from cpu, a replay may run any of them
+    void (*remove)(scheduler* sch, vcpu* cpu, thread* tr);
+    // 1 if the best ready thread of cpu should take it from curr
+    int (*preempts)(scheduler* sch, vcpu* cpu, thread* curr);
+    // the best ready thread of cpu compared with the other CPUs, higher
+    // is more urgent and -1 means nothing is ready, used to steal work
+    int (*urgency)(vcpu* cpu);
+    // tr made a scheduler call, NULL if the policy does not care
+    void (*charge)(scheduler* sch, thread* tr);
+    // tr used up its whole quantum, NULL if nothing changes
+    void (*expired)(scheduler* sch, thread* tr);
+    // called before every decision on cpu, NULL if not needed
+    void (*tick)(scheduler* sch, vcpu* cpu);
+};
+
+extern const sched_policy policy_prio;
+extern const sched_policy policy_mlfq;
+extern const sched_policy policy_fair;
+
+// per level round robin queues shared by the priority based policies
+void level_enqueue(scheduler* sch, vcpu* cpu, thread* tr);
+
+thread* level_dequeue(scheduler* sch, vcpu* cpu);
+
+void level_remove(scheduler* sch, vcpu* cpu, thread* tr);
+
+int level_preempts(scheduler* sch, vcpu* cpu, thread* curr);
+
+int level_urgency(vcpu* cpu);
+
+#endif
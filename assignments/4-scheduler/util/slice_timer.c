@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "slice_timer.h"
+
+static void* timer_thread(void* arg)
+{
+    slice_timer* t = (slice_timer*)arg;
+    uint64_t expirations;
+
+    while (read(t->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        if (__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        t->tick(t->arg);
+    }
+    return NULL;
+}
+
+int slice_timer_start(slice_timer* t, unsigned long long period_ns,
+                      void (*tick)(void* arg), void* arg)
+{
+    struct itimerspec its;
+
+    t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (t->fd < 0) {
+        return -1;
+    }
+    t->stop = 0;
+    t->tick = tick;
+    t->arg = arg;
+
+    its.it_interval.tv_sec = period_ns / 1000000000ULL;
+    its.it_interval.tv_nsec = period_ns % 1000000000ULL;
+    its.it_value = its.it_interval;
+    if (timerfd_settime(t->fd, 0, &its, NULL) < 0 ||
+        pthread_create(&t->thread, NULL, timer_thread, t) != 0) {
+        close(t->fd);
+        return -1;
+    }
+    return 0;
+}
+
+// returns after the last tick, at most one period later
+void slice_timer_stop(slice_timer* t)
+{
+    __atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(t->thread, NULL);
+    close(t->fd);
+}
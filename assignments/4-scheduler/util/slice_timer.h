@@ -0,0 +1,20 @@
+#ifndef SLICE_TIMER_H
+#define SLICE_TIMER_H
+#include <pthread.h>
+
+// Periodic timer for the wall clock quantum. A helper thread blocks on a
+// timerfd and calls tick(arg) once per period until slice_timer_stop.
+typedef struct slice_timer {
+    int fd;
+    int stop;
+    pthread_t thread;
+    void (*tick)(void* arg);
+    void* arg;
+} slice_timer;
+
+int slice_timer_start(slice_timer* t, unsigned long long period_ns,
+                      void (*tick)(void* arg), void* arg);
+
+void slice_timer_stop(slice_timer* t);
+
+#endif
@@ -1,182 +1,548 @@
 #include <stdlib.h>
+#include <errno.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <signal.h>
+#include <poll.h>
+#ifdef SO_FUTEX
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 #include "types.h"
-#include "circular_queue.h"
+#include "task_queue.h"
+#include "sched_core.h"
+#include "sched_deadline.h"
+#include "task_table.h"
+#include "tcb_slab.h"
+#include "task_stack.h"
+#include "fd_poller.h"
+#include "trace.h"
+#include "slice_timer.h"
+#include "sched_clock.h"
 
-static scheduler* sch = NULL;
-static pthread_mutex_t sch_mutex;
-static pthread_cond_t is_running_thread;
-static sem_t not_terminated_threads;
-static sem_t all_threads_terminated;
-static int main_thread_running = 0;
-static thread* main_thread;
+// where take_tcb_locked found a control block
+#define TCB_IDLE 0
+#define TCB_EXITED 1
+#define TCB_NEW 2
+
+// thread.preempt: the slice timer asked the running thread to stop, then
+// it waits in preempt_signal until it is dispatched again
+#define PREEMPT_NONE 0
+#define PREEMPT_ASKED 1
+#define PREEMPT_STOPPED 2
+
+// one scheduler instance, each one has its own queues, lock and workers
+struct so_sched {
+    scheduler core;
+    pthread_mutex_t mutex;
+    // forked tasks whose handler did not return yet, so_end waits for 0
+    unsigned int live_tasks;
+    // futex backend: the thread given a CPU, woken once the lock is free
+    thread* handoff;
+    // stands for every thread that calls in from outside the instance
+    thread* main_thread;
+    // set when the task the main thread joins is done, see so_join
+    int main_joined;
+    // wall clock quantum, see so_opts_t.slice
+    slice_timer timer;
+    // so_wait_fd, the poller thread starts with the first wait
+    fd_poller poller;
+    int poller_on;
+};
+
+// the instance of so_init, used by the calls made outside of any task
+static so_sched_t* default_sched = NULL;
+// control block of the calling task, NULL outside of tasks
+static __thread thread* current TLS_FAST;
+// SO_PREEMPT_SIGNAL is handled while an instance preempts asynchronously
+static pthread_mutex_t preempt_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int preempt_users;
+static struct sigaction old_preempt_action;
 
 void* thread_function(void* arg);
-void  check_scheduler(void);
-void  wait_to_run(void);
-void  decrease_quantum(void);
-int   preempted(void);
+void  run_task(thread* tr);
+int   wait_for_task(thread* tr);
+void  task_terminated_locked(so_sched_t* s);
+void  park_init(thread* tr);
+void  park_destroy(thread* tr);
+void  park_locked(so_sched_t* s, thread* self);
+void  unpark(thread* tr);
+void  unlock_instance(so_sched_t* s);
+void  check_scheduler(so_sched_t* s, unsigned long long stack_used);
+void  wait_to_run(so_sched_t* s);
+void  wait_to_run_locked(so_sched_t* s, thread* self);
+void  wake_thread(thread* tr);
+void  schedule_locked(so_sched_t* s, thread* self);
+int   signal_io(so_sched_t* s, unsigned int io, unsigned int n, int all);
+thread* take_tcb_locked(scheduler* sch, int* from);
+int   setup_task(so_sched_t* s, thread* tr, int from, so_handler* func,
+                 unsigned int priority, unsigned int period, unsigned int budget);
+void  start_task_locked(so_sched_t* s, thread* tr);
+tid_t fork_task(so_sched_t* s, so_handler* func, unsigned int priority,
+                unsigned int period, unsigned int budget);
+int   start_slice_timer(so_sched_t* s);
+void  stop_slice_timer(so_sched_t* s);
+int   hold_preempt_signal(void);
+void  release_preempt_signal(void);
+void  slice_tick(void* arg);
+void  preempt_signal(int sig);
+int   resume_preempted(thread* tr);
+int   start_poller(so_sched_t* s);
+void  fd_ready(void* arg, thread* tr, unsigned int events);
+
+static inline so_sched_t* instance_of(thread* tr) {
+    return (so_sched_t*)tr->owner;
+}
+
+// the scheduler of the calling task, or the default one outside of tasks
+static inline so_sched_t* here(void) {
+    return current != NULL ? instance_of(current) : default_sched;
+}
+
+// control block of the caller inside s: its own task, or the main thread
+// of s for a thread that does not belong to s
+static inline thread* self_in(so_sched_t* s) {
+    return current != NULL && instance_of(current) == s ? current : s->main_thread;
+}
+
+// the slice timer reads in_sched of other threads without the lock
+static inline void enter_sched(void) {
+    if (current != NULL) {
+        __atomic_store_n(&current->in_sched, current->in_sched + 1, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void leave_sched(void) {
+    if (current != NULL) {
+        __atomic_store_n(&current->in_sched, current->in_sched - 1, __ATOMIC_RELAXED);
+    }
+}
+
+// a task holding the lock of an instance counts as inside the scheduler
+// until unlock_instance, so preempt_signal never stops it with the lock
+static inline void lock_instance(so_sched_t* s) {
+    enter_sched();
+    pthread_mutex_lock(&s->mutex);
+}
 
 DECL_PREFIX int so_init(unsigned int time_quantum, unsigned int io) {
-    if (time_quantum == 0) {
+    return so_init_ex(time_quantum, io, NULL);
+}
+
+DECL_PREFIX int so_init_ex(unsigned int time_quantum, unsigned int io,
+                           const so_opts_t *opts) {
+    if (default_sched != NULL) {
         return -1;
     }
 
-    if (io > SO_MAX_NUM_EVENTS) {
-        return -1;
+    default_sched = so_sched_create(time_quantum, io, opts);
+    return default_sched != NULL ? 0 : -1;
+}
+
+DECL_PREFIX so_sched_t *so_sched_create(unsigned int time_quantum, unsigned int io,
+                                        const so_opts_t *opts) {
+    if (time_quantum == 0) {
+        return NULL;
     }
 
-    if (sch != NULL) {
-        return -1;
+    if (io > SO_MAX_NUM_EVENTS) {
+        return NULL;
     }
 
-    sch = calloc(1, sizeof(*sch));
+    so_sched_t* s = calloc(1, sizeof(*s));
 
-    if (sch == NULL) {
-        return -1;
+    if (s == NULL) {
+        return NULL;
     }
+    scheduler* sch = &s->core;
 
-    sch->time_quantum = time_quantum;
-    sch->io = io;
-    // no of all created threads
-    sch->no_threads = 0;
-    sch->no_terminated_threads = 0;
     // main thread
-    main_thread = calloc(1, sizeof(thread));
-    sch->running_thread = main_thread;
-    sch->running_thread->tid = pthread_self();
-    main_thread_running = 1;
+    s->main_thread = tcb_alloc(&sch->tcbs);
+    if (s->main_thread == NULL || sched_init(sch, time_quantum, io, opts, s->main_thread) < 0) {
+        tcb_slab_destroy(&sch->tcbs);
+        free(s);
+        return NULL;
+    }
+    sch->pool_size = opts != NULL ? opts->pool_size : 0;
+    sch->shutting_down = 0;
+    sch->wake = wake_thread;
+    s->main_thread->tid = pthread_self();
+    park_init(s->main_thread);
+
+    pthread_mutex_init(&s->mutex, NULL);
 
-    for (int i = 0; i <= SO_MAX_PRIO; ++i) {
-        init_queue(&sch->ready_queues[i]);
+    if (sch->slice_ns != 0 && start_slice_timer(s) < 0) {
+        sch->slice_ns = 0;
+        so_sched_destroy(s);
+        return NULL;
     }
 
-    for (int i = 0; i < SO_MAX_NUM_EVENTS; ++i) {
-        init_queue(&sch->waiting_queues[i]);
+    return s;
+}
+
+// the signal handler is shared by the instances, the first one installs
+// it and the last one puts the old handler back
+int hold_preempt_signal() {
+    int ret = 0;
+
+    pthread_mutex_lock(&preempt_lock);
+    if (preempt_users == 0) {
+        struct sigaction sa = {0};
+        sa.sa_handler = preempt_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        ret = sigaction(SO_PREEMPT_SIGNAL, &sa, &old_preempt_action);
+    }
+    if (ret == 0) {
+        ++preempt_users;
+    }
+    pthread_mutex_unlock(&preempt_lock);
+    return ret;
+}
+
+void release_preempt_signal() {
+    pthread_mutex_lock(&preempt_lock);
+    if (--preempt_users == 0) {
+        sigaction(SO_PREEMPT_SIGNAL, &old_preempt_action, NULL);
     }
+    pthread_mutex_unlock(&preempt_lock);
+}
 
-    pthread_mutex_init(&sch_mutex, NULL);
-    pthread_cond_init(&is_running_thread, NULL);
-    sem_init(&not_terminated_threads, 0, 0);
-    sem_init(&all_threads_terminated, 0, 0);
+// the timer ticks four times per quantum, so a slice runs at most a
+// quarter of the quantum too long, half of it when SO_PREEMPT_SIGNAL has
+// to stop the task first
+int start_slice_timer(so_sched_t* s) {
+    unsigned long long period = s->core.slice_ns / 4;
 
+    if (s->core.async_preempt && hold_preempt_signal() < 0) {
+        return -1;
+    }
+
+    if (slice_timer_start(&s->timer, period > 0 ? period : 1, slice_tick, s) < 0) {
+        if (s->core.async_preempt) {
+            release_preempt_signal();
+        }
+        return -1;
+    }
     return 0;
 }
 
-void* thread_function(void* arg) {
+void stop_slice_timer(so_sched_t* s) {
+    slice_timer_stop(&s->timer);
+    if (s->core.async_preempt) {
+        release_preempt_signal();
+    }
+}
 
-    thread* tr = (thread*)arg;
-    unsigned int priority = tr->priority;
-    // assign tid before waiting to run
-    tr->tid = pthread_self();
+// runs on the timer thread of s; a task that used up its wall clock
+// quantum outside of the scheduler is first asked to stop with
+// SO_PREEMPT_SIGNAL, and once it waits in preempt_signal a later tick
+// switches its CPU for it
+void slice_tick(void* arg) {
+    so_sched_t* s = arg;
+    scheduler* sch = &s->core;
+    unsigned long long now = now_ns();
+
+    lock_instance(s);
+    // sleeping threads wake up on time even while no task calls in
+    sched_expire(sch);
+    for (unsigned int i = 0; i < sch->ncpus; ++i) {
+        vcpu* c = &sch->cpus[i];
 
-    wait_to_run();
+        sched_tick(sch, i, now);
+        if (!sch->async_preempt || !__atomic_load_n(&c->slice_expired, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        thread* tr = c->running;
+        if (tr == NULL || tr == sch->main_thread) {
+            continue;
+        }
+        if (__atomic_load_n(&tr->preempt, __ATOMIC_ACQUIRE) == PREEMPT_STOPPED) {
+            sched_pick(sch, i);
+        }
+        // a thread inside the scheduler is preempted by its own call
+        else if (!__atomic_load_n(&tr->in_sched, __ATOMIC_RELAXED)) {
+            int none = PREEMPT_NONE;
+            __atomic_compare_exchange_n(&tr->preempt, &none, PREEMPT_ASKED, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            pthread_kill(tr->tid, SO_PREEMPT_SIGNAL);
+        }
+    }
+    unlock_instance(s);
+}
+
+// stops a task the slice timer asked to give up its CPU until it is
+// dispatched again, see resume_preempted. Only atomics and async signal
+// safe calls are made here: the task is outside of the scheduler and
+// holds no lock of the library, the timer thread takes the scheduler
+// decision for it and nothing else touches its state meanwhile.
+void preempt_signal(int sig) {
+    thread* tr = current;
+    int asked = PREEMPT_ASKED;
+
+    if (tr == NULL || tr->in_sched ||
+        !__atomic_compare_exchange_n(&tr->preempt, &asked, PREEMPT_STOPPED, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    int saved_errno = errno;
+    // the signal is blocked while it is handled, sigsuspend lets the one
+    // of resume_preempted in without missing it
+    sigset_t mask;
+    pthread_sigmask(SIG_BLOCK, NULL, &mask);
+    sigdelset(&mask, sig);
+    while (__atomic_load_n(&tr->preempt, __ATOMIC_ACQUIRE) == PREEMPT_STOPPED) {
+        sigsuspend(&mask);
+    }
+    errno = saved_errno;
+}
+
+// called with the lock held when tr is dispatched, a task stopped in
+// preempt_signal is let go with the same signal
+// returns 1 if tr was stopped there
+int resume_preempted(thread* tr) {
+    if (!instance_of(tr)->core.async_preempt ||
+        __atomic_exchange_n(&tr->preempt, PREEMPT_NONE, __ATOMIC_ACQ_REL) != PREEMPT_STOPPED) {
+        return 0;
+    }
+    pthread_kill(tr->tid, SO_PREEMPT_SIGNAL);
+    return 1;
+}
+
+// runs the handler of tr and hands the CPU to the next thread
+void run_task(thread* tr) {
+    so_sched_t* s = instance_of(tr);
+
+    wait_to_run(s);
     tr->work_done = 0;
-    tr->func(priority);
+    leave_sched();
+    tr->func(tr->priority);
+    enter_sched();
     tr->work_done = 1;
+    // measured from the stack itself, before another task can take it
+    unsigned long long stack_used = s->core.stats_on ? stack_peak(tr->stack, s->core.stack_size) : 0;
+
+    // the next running thread is woken by the scheduler
+    check_scheduler(s, stack_used);
+}
+
+// keeps the finished task tr as a zombie until it is joined or detached,
+// then parks its worker in the pool until so_fork assigns it a new
+// handler, or lets the worker exit if the pool is full; an exited worker
+// leaves its control block and stack to the next fork
+// returns 0 when the worker exits
+int wait_for_task(thread* tr) {
+    so_sched_t* s = instance_of(tr);
+    scheduler* sch = &s->core;
 
-    check_scheduler();
+    lock_instance(s);
+    task_terminated_locked(s);
+    if (tr->joiner == s->main_thread) {
+        s->main_joined = 1;
+        unpark(s->main_thread);
+    }
+    if (!tr->detached && tr->joiner == NULL) {
+        tr->zombie = 1;
+        enqueue(&sch->terminated_threads, tr);
+        while (!tr->detached && tr->joiner == NULL && sch->shutting_down == 0) {
+            park_locked(s, tr);
+        }
+        // so_end joins the zombies that are left
+        if (sch->shutting_down) {
+            unlock_instance(s);
+            return 0;
+        }
+        tr->zombie = 0;
+        remove_from_queue(&sch->terminated_threads, tr);
+    }
 
-    if (preempted()) {
-        // signal so new running thread can run
-        // if not preempted, no reason to signal since this is running thread
-        pthread_mutex_lock(&sch_mutex);
-        pthread_cond_broadcast(&is_running_thread);
-        pthread_mutex_unlock(&sch_mutex);
+    // nobody can join the task any more, the worker exits
+    if (sch->idle_workers.no_elem >= sch->pool_size) {
+        table_remove(&sch->tasks, tr);
+        enqueue(&sch->exited_workers, tr);
+        unlock_instance(s);
+        current = NULL;
+        return 0;
     }
+    tr->assigned = 0;
+    enqueue(&sch->idle_workers, tr);
+    while (tr->assigned == 0 && sch->shutting_down == 0) {
+        park_locked(s, tr);
+    }
+    int assigned = tr->assigned;
+    unlock_instance(s);
 
-    pthread_mutex_lock(&sch_mutex);
-    sch->terminated_threads[sch->no_terminated_threads++] = tr;
-    pthread_mutex_unlock(&sch_mutex);
+    return assigned;
+}
 
-    sem_wait(&not_terminated_threads);
-    int no_not_terminated;
-    sem_getvalue(&not_terminated_threads, &no_not_terminated);
-    if (no_not_terminated == 0) {
-        sem_post(&all_threads_terminated);
+// the last task to finish wakes so_end
+void task_terminated_locked(so_sched_t* s) {
+    if (--s->live_tasks == 0) {
+        unpark(s->main_thread);
     }
+}
+
+void* thread_function(void* arg) {
+
+    thread* tr = (thread*)arg;
+    current = tr;
+    enter_sched();
+
+    do {
+        run_task(tr);
+    } while (wait_for_task(tr));
 
     return NULL;
 }
 
-void check_scheduler() {
-    pthread_mutex_lock(&sch_mutex);
-    thread* curr = sch->running_thread;
-    if (curr->time_quantum == 0 || curr->work_done == 1) {
-        if (main_thread->tid != curr->tid && curr->work_done == 0 && curr->waiting == 0) {
-            enqueue(&sch->ready_queues[curr->priority], curr);
-        }
-        curr = NULL;
+void check_scheduler(so_sched_t* s, unsigned long long stack_used) {
+    lock_instance(s);
+    if (s->core.stats_on) {
+        sched_stack_peak(&s->core, current, stack_used);
     }
+    sched_pick(&s->core, current->cpu);
+    unlock_instance(s);
+}
 
-    thread* next = NULL;
-    for (int i = SO_MAX_PRIO; i >= 0; --i) {
-        thread* tr = front(&sch->ready_queues[i]);
+void wait_to_run(so_sched_t* s) {
+    lock_instance(s);
+    wait_to_run_locked(s, current);
+    unlock_instance(s);
+}
 
-        if (tr == NULL) {
-            continue;
-        }
+void wait_to_run_locked(so_sched_t* s, thread* self) {
+    while (s->core.cpus[self->cpu].running != self) {
+        park_locked(s, self);
+    }
+}
 
-        if (curr == NULL || main_thread_running == 1 || curr->waiting == 1) {
-            dequeue(&sch->ready_queues[i]);
-            main_thread_running = 0;
-            next = tr;
-            break;
+#ifdef SO_FUTEX
+// called with the lock of the instance held, the chosen thread is marked
+// runnable now and woken by unlock_instance, so it does not wake up only
+// to block on the lock
+void wake_thread(thread* tr) {
+    so_sched_t* s = instance_of(tr);
+
+    if (resume_preempted(tr)) {
+        return;
+    }
+    if (__atomic_exchange_n(&tr->park_word, 1, __ATOMIC_RELEASE) != 2) {
+        return;
+    }
+    if (s->handoff != NULL) {
+        syscall(SYS_futex, &s->handoff->park_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+    s->handoff = tr;
+}
+
+// a woken thread may already run again and park on its word, a spare
+// FUTEX_WAKE is harmless, the control blocks outlive the workers
+void unlock_instance(so_sched_t* s) {
+    thread* next = s->handoff;
+
+    s->handoff = NULL;
+    pthread_mutex_unlock(&s->mutex);
+    if (next != NULL) {
+        syscall(SYS_futex, &next->park_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+    leave_sched();
+}
+
+// every thread parks on its own futex word: 0 while it should park, 2
+// once it sleeps in the kernel and 1 when it was unparked, so unpark
+// only makes a system call for a thread that really sleeps
+void park_init(thread* tr) {
+    tr->park_word = 0;
+}
+
+void park_destroy(thread* tr) {
+    (void)tr;
+}
+
+// sleeps until unpark(self), the callers check their own condition again
+void park_locked(so_sched_t* s, thread* self) {
+    __atomic_store_n(&self->park_word, 0, __ATOMIC_RELAXED);
+    unlock_instance(s);
+    for (;;) {
+        unsigned int word = 0;
+
+        if (__atomic_compare_exchange_n(&self->park_word, &word, 2, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            word = 2;
         }
-        else {
-            if (tr->priority > curr->priority) {
-                dequeue(&sch->ready_queues[i]);
-                if (curr->work_done == 0 && curr->waiting == 0) {
-                    enqueue(&sch->ready_queues[curr->priority], curr);
-                }
-                next = tr;
-                break;
-            }
+        if (word == 1) {
+            break;
         }
+        syscall(SYS_futex, &self->park_word, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
     }
+    lock_instance(s);
+}
 
-    if (next == NULL) {
-        pthread_mutex_unlock(&sch_mutex);
-        return;
+void unpark(thread* tr) {
+    if (__atomic_exchange_n(&tr->park_word, 1, __ATOMIC_RELEASE) == 2) {
+        syscall(SYS_futex, &tr->park_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
     }
-    else {
+}
+#else
+// called with the lock of the instance held, only the chosen thread is
+// woken
+void wake_thread(thread* tr) {
+    if (!resume_preempted(tr)) {
+        unpark(tr);
     }
+}
 
-    next->time_quantum = sch->time_quantum;
-    sch->running_thread = next;
+void unlock_instance(so_sched_t* s) {
+    pthread_mutex_unlock(&s->mutex);
+    leave_sched();
+}
 
-    pthread_mutex_unlock(&sch_mutex);
-    return;
+void park_init(thread* tr) {
+    pthread_cond_init(&tr->run_cond, NULL);
 }
 
-void wait_to_run() {
-    pthread_mutex_lock(&sch_mutex);
-    while (pthread_self() != sch->running_thread->tid) {
-        pthread_cond_wait(&is_running_thread, &sch_mutex);
-    }
-    pthread_mutex_unlock(&sch_mutex);
+void park_destroy(thread* tr) {
+    pthread_cond_destroy(&tr->run_cond);
 }
 
-void decrease_quantum() {
-    pthread_mutex_lock(&sch_mutex);
-    --sch->running_thread->time_quantum;
-    pthread_mutex_unlock(&sch_mutex);
+// sleeps until unpark(self) or spuriously, the callers check their own
+// condition again
+void park_locked(so_sched_t* s, thread* self) {
+    pthread_cond_wait(&self->run_cond, &s->mutex);
 }
 
-int preempted() {
-    int ret = 0;
-    pthread_mutex_lock(&sch_mutex);
-    if (sch->running_thread->tid != pthread_self()) {
-        ret = 1;
+void unpark(thread* tr) {
+    pthread_cond_signal(&tr->run_cond);
+}
+#endif
+
+// charges the calling thread, hands the CPU over if needed and waits until
+// it runs again, all in the critical section the caller already holds.
+// Once the first task runs, the main thread and the threads outside of s
+// own no CPU: they neither pay for their calls nor preempt the running
+// task, which is still inside its handler.
+void schedule_locked(so_sched_t* s, thread* self) {
+    if (self == s->main_thread && s->core.cpus[self->cpu].running != self) {
+        sched_fill_idle(&s->core);
+        return;
+    }
+    sched_charge(&s->core, self);
+    sched_pick(&s->core, self->cpu);
+    // the main thread is not scheduled, it only waits in so_end
+    if (self != s->main_thread) {
+        wait_to_run_locked(s, self);
     }
-    pthread_mutex_unlock(&sch_mutex);
-    return ret;
 }
 
 DECL_PREFIX tid_t so_fork(so_handler *func, unsigned int priority) {
+    return so_sched_fork(here(), func, priority);
+}
+
+DECL_PREFIX tid_t so_sched_fork(so_sched_t *s, so_handler *func,
+                                unsigned int priority) {
     // do work
-    if (func == 0) {
+    if (s == NULL || func == 0) {
         return INVALID_TID;
     }
 
@@ -184,155 +550,564 @@ DECL_PREFIX tid_t so_fork(so_handler *func, unsigned int priority) {
         return INVALID_TID;
     }
 
-    thread* tr = malloc(sizeof(thread));
+    return fork_task(s, func, priority, 0, 0);
+}
+
+// the control blocks are taken and the tasks queued under one lock each,
+// the kernel threads are created in between
+DECL_PREFIX int so_fork_many(so_handler *const *funcs, const unsigned int *prios,
+                             unsigned int n, tid_t *tids_out) {
+    so_sched_t* s = here();
+
+    if (s == NULL || funcs == NULL || prios == NULL) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < n; ++i) {
+        if (funcs[i] == 0 || prios[i] > SO_MAX_PRIO) {
+            return -1;
+        }
+    }
+
+    thread* self = self_in(s);
+    int created = 0;
+
+    // preempt_signal must not stop the task inside malloc or free either
+    enter_sched();
+    // n can be 0, keep at least one byte so malloc never returns NULL
+    struct {
+        thread* tr;
+        int from;
+    } *batch = malloc(n * sizeof(*batch) + 1);
+    if (batch == NULL) {
+        leave_sched();
+        return -1;
+    }
+
+    lock_instance(s);
+    for (unsigned int i = 0; i < n; ++i) {
+        batch[i].tr = take_tcb_locked(&s->core, &batch[i].from);
+    }
+    unlock_instance(s);
+
+    for (unsigned int i = 0; i < n; ++i) {
+        if (batch[i].tr != NULL &&
+            setup_task(s, batch[i].tr, batch[i].from, funcs[i], prios[i], 0, 0) < 0) {
+            batch[i].tr = NULL;
+        }
+        if (tids_out != NULL) {
+            tids_out[i] = batch[i].tr != NULL ? batch[i].tr->tid : INVALID_TID;
+        }
+        created += batch[i].tr != NULL;
+    }
+
+    if (created > 0) {
+        lock_instance(s);
+        for (unsigned int i = 0; i < n; ++i) {
+            if (batch[i].tr != NULL) {
+                start_task_locked(s, batch[i].tr);
+            }
+        }
+        schedule_locked(s, self);
+        unlock_instance(s);
+    }
+    free(batch);
+    leave_sched();
+
+    return created;
+}
+
+DECL_PREFIX tid_t so_fork_deadline(so_handler *func, unsigned int period,
+                                   unsigned int budget) {
+    so_sched_t* s = here();
+
+    if (func == 0 || s == NULL) {
+        return INVALID_TID;
+    }
+
+    lock_instance(s);
+    int admitted = edf_admit(&s->core, period, budget);
+    unlock_instance(s);
+    if (admitted < 0) {
+        return INVALID_TID;
+    }
+
+    tid_t tid = fork_task(s, func, SO_MAX_PRIO, period, budget);
+    if (tid == INVALID_TID) {
+        lock_instance(s);
+        edf_release(&s->core, period, budget);
+        unlock_instance(s);
+    }
+    return tid;
+}
+
+// a period of 0 forks a task of the scheduling policy, anything else a
+// deadline task whose share is already reserved
+// control block for a new task: a pooled worker, an exited worker whose
+// thread setup_task still has to join, or a fresh one
+thread* take_tcb_locked(scheduler* sch, int* from) {
+    thread* tr = dequeue(&sch->idle_workers);
+
+    *from = TCB_IDLE;
+    if (tr == NULL) {
+        tr = dequeue(&sch->exited_workers);
+        *from = TCB_EXITED;
+    }
+    if (tr == NULL) {
+        tr = tcb_alloc(&sch->tcbs);
+        *from = TCB_NEW;
+    }
+    return tr;
+}
+
+// gives tr the handler and a kernel thread, called without the lock
+// returns 0 on success or -1 after releasing tr
+int setup_task(so_sched_t* s, thread* tr, int from, so_handler* func,
+               unsigned int priority, unsigned int period, unsigned int budget) {
+    scheduler* sch = &s->core;
+
+    if (from == TCB_EXITED) {
+        // a new worker starts on the stack of the old one
+        pthread_join(tr->tid, NULL);
+        tr->tid = 0;
+    }
+    else if (from == TCB_NEW) {
+        park_init(tr);
+        // the new thread looks its scheduler up before sched_fork runs
+        tr->owner = sch;
+        tr->stack = stack_alloc(sch->stack_size);
+        if (tr->stack == NULL) {
+            park_destroy(tr);
+            lock_instance(s);
+            tcb_free(&sch->tcbs, tr);
+            unlock_instance(s);
+            return -1;
+        }
+    }
     tr->time_quantum = sch->time_quantum;
     tr->priority = priority;
+    tr->edf = period != 0;
+    tr->period = period;
+    tr->budget = budget;
     tr->func = func;
     tr->work_done = 0;
-    tr->tid = 0;
     tr->waiting = 0;
+    tr->detached = sch->detach_all;
+    tr->joiner = NULL;
+    // start next to the parent, idle CPUs steal it if needed
+    tr->cpu = self_in(s)->cpu;
 
+    if (tr->tid == 0) {
+        // the worker that left the control block exited inside the
+        // scheduler, the new one counts its depth from scratch
+        tr->in_sched = 0;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstack(&attr, tr->stack, sch->stack_size);
+        int ret = pthread_create(&tr->tid, &attr, thread_function, tr);
+        pthread_attr_destroy(&attr);
+        if (ret != 0) {
+            park_destroy(tr);
+            stack_free(tr->stack, sch->stack_size);
+            lock_instance(s);
+            tcb_free(&sch->tcbs, tr);
+            unlock_instance(s);
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    pthread_t ptr;
-    pthread_mutex_lock(&sch_mutex);
-    sch->no_threads++;
-    pthread_mutex_unlock(&sch_mutex);
-    sem_post(&not_terminated_threads);
+// placing thread in ready after creation
+// an idle worker sleeps on until the scheduler wakes it to run
+void start_task_locked(so_sched_t* s, thread* tr) {
+    ++s->live_tasks;
+    tr->assigned = 1;
+    sched_fork(&s->core, tr);
+}
 
-    pthread_create(&ptr, NULL, thread_function, tr);
-    // end do work
+tid_t fork_task(so_sched_t* s, so_handler* func, unsigned int priority,
+                unsigned int period, unsigned int budget) {
+    thread* self = self_in(s);
+    int from;
+
+    enter_sched();
+    lock_instance(s);
+    thread* tr = take_tcb_locked(&s->core, &from);
+    unlock_instance(s);
+
+    if (tr == NULL || setup_task(s, tr, from, func, priority, period, budget) < 0) {
+        leave_sched();
+        return INVALID_TID;
+    }
+    tid_t ptr = tr->tid;
 
-    // placing thread in ready after creation
-    pthread_mutex_lock(&sch_mutex);
-    enqueue(&sch->ready_queues[priority], tr);
-    pthread_mutex_unlock(&sch_mutex);
+    lock_instance(s);
+    start_task_locked(s, tr);
+    schedule_locked(s, self);
+    unlock_instance(s);
+    leave_sched();
 
-    decrease_quantum();
+    return ptr;
+}
 
-    check_scheduler();
+DECL_PREFIX int so_join(tid_t tid) {
+    so_sched_t* s = here();
 
-    if (preempted()) {
-        // signal so new running thread can run
-        // if not preempted, no reason to signal since this is running thread
-        pthread_mutex_lock(&sch_mutex);
-        pthread_cond_broadcast(&is_running_thread);
-        pthread_mutex_unlock(&sch_mutex);
+    if (s == NULL) {
+        return -1;
+    }
+    thread* self = self_in(s);
 
-        if (main_thread->tid != pthread_self()) {
-            wait_to_run();
+    lock_instance(s);
+    thread* tr = table_find(&s->core.tasks, tid);
+    if (tr == NULL || tr == self || tr->detached || tr->joiner != NULL) {
+        unlock_instance(s);
+        return -1;
+    }
+
+    if (tr->zombie) {
+        // the zombie worker wakes up and reclaims itself
+        tr->joiner = self;
+        unpark(tr);
+    }
+    else if (self == s->main_thread) {
+        // the main thread is not scheduled, the worker of tr wakes it
+        s->main_joined = 0;
+        tr->joiner = self;
+        while (!s->main_joined) {
+            park_locked(s, s->main_thread);
         }
     }
+    else {
+        sched_join(&s->core, self, tr);
+        schedule_locked(s, self);
+    }
+    unlock_instance(s);
 
-    return ptr;
+    return 0;
+}
+
+DECL_PREFIX int so_detach(tid_t tid) {
+    so_sched_t* s = here();
+
+    if (s == NULL) {
+        return -1;
+    }
+
+    lock_instance(s);
+    thread* tr = table_find(&s->core.tasks, tid);
+    if (tr == NULL || tr->detached || tr->joiner != NULL) {
+        unlock_instance(s);
+        return -1;
+    }
+    tr->detached = 1;
+    if (tr->zombie) {
+        unpark(tr);
+    }
+    unlock_instance(s);
+
+    return 0;
+}
+
+// a task keeps its kernel thread
+DECL_PREFIX tid_t so_self(void) {
+    return current != NULL ? current->tid : pthread_self();
 }
 
 DECL_PREFIX int so_wait(unsigned int io) {
+    so_sched_t* s = here();
+    thread* self = self_in(s);
+
     // do work
-    pthread_mutex_lock(&sch_mutex);
-    if (io >= sch->io) {
-        pthread_mutex_unlock(&sch_mutex);
+    lock_instance(s);
+    if (io >= s->core.io) {
+        unlock_instance(s);
         return -1;
     }
 
-    sch->running_thread->waiting = 1;
-    enqueue(&sch->waiting_queues[io], sch->running_thread);
-    pthread_mutex_unlock(&sch_mutex);
+    // this thread cannot run until signaled, unless a counting device
+    // had a signal left
+    sched_wait(&s->core, self, io);
+    schedule_locked(s, self);
+    unlock_instance(s);
     // end do work
 
-    decrease_quantum();
-    check_scheduler();
+    return 0;
+}
+
+DECL_PREFIX int so_wait_timeout(unsigned int io, unsigned int units) {
+    so_sched_t* s = here();
+    thread* self = self_in(s);
 
-    // signal so new running thread can run
-    // since this thread cannot run until signaled
-    pthread_mutex_lock(&sch_mutex);
-    pthread_cond_broadcast(&is_running_thread);
-    pthread_mutex_unlock(&sch_mutex);
+    lock_instance(s);
+    if (io >= s->core.io) {
+        unlock_instance(s);
+        return -1;
+    }
+
+    sched_wait_timeout(&s->core, self, io, units);
+    schedule_locked(s, self);
+    int timed_out = self->timed_out;
+    unlock_instance(s);
+
+    return timed_out;
+}
+
+DECL_PREFIX int so_sleep(unsigned int units) {
+    so_sched_t* s = here();
+
+    if (s == NULL) {
+        return -1;
+    }
+    thread* self = self_in(s);
+
+    lock_instance(s);
+    sched_sleep(&s->core, self, units);
+    schedule_locked(s, self);
+    unlock_instance(s);
 
-    wait_to_run();
     return 0;
 }
 
-DECL_PREFIX int so_signal(unsigned int io) {
+// called with the lock of the instance held
+int start_poller(so_sched_t* s) {
+    if (s->poller_on) {
+        return 0;
+    }
+    if (fd_poller_init(&s->poller) < 0) {
+        return -1;
+    }
+    if (fd_poller_start(&s->poller, fd_ready, s) < 0) {
+        fd_poller_destroy(&s->poller);
+        return -1;
+    }
+    s->poller_on = 1;
+    return 0;
+}
 
-    // do work
-    pthread_mutex_lock(&sch_mutex);
-    if (io >= sch->io) {
-        pthread_mutex_unlock(&sch_mutex);
+// runs on the poller thread of s
+void fd_ready(void* arg, thread* tr, unsigned int events) {
+    so_sched_t* s = arg;
+
+    lock_instance(s);
+    sched_fd_ready(&s->core, tr, events);
+    unlock_instance(s);
+}
+
+DECL_PREFIX int so_wait_fd(int fd, unsigned int events) {
+    so_sched_t* s = here();
+
+    if (s == NULL) {
         return -1;
     }
+    thread* self = self_in(s);
 
-    thread* tr = NULL;
-    int threads_signaled = 0;
-    do {
-        tr = dequeue(&sch->waiting_queues[io]);
-        if (tr == NULL) {
-            break;
-        }
-        tr->waiting = 0;
-        ++threads_signaled;
-        enqueue(&sch->ready_queues[tr->priority], tr);
-    } while(1);
+    // the main thread is not scheduled, it simply blocks
+    if (self == s->main_thread) {
+        struct pollfd pfd = { .fd = fd, .events = events };
+        return poll(&pfd, 1, -1) < 0 ? -1 : (unsigned short)pfd.revents;
+    }
 
-    pthread_mutex_unlock(&sch_mutex);
-    // end do work
+    lock_instance(s);
+    if (start_poller(s) < 0 || fd_poller_add(&s->poller, self, fd, events) < 0) {
+        unlock_instance(s);
+        return -1;
+    }
+    sched_wait_fd(&s->core, self, fd);
+    schedule_locked(s, self);
+    int ready = self->fd_events;
+    unlock_instance(s);
 
-    decrease_quantum();
-    check_scheduler();
-    if (preempted()) {
-        // signal so new running thread can run
-        // if not preempted, no reason to signal since this is running thread
-        pthread_mutex_lock(&sch_mutex);
-        pthread_cond_broadcast(&is_running_thread);
-        pthread_mutex_unlock(&sch_mutex);
+    return ready;
+}
 
-        wait_to_run();
+// wakes n waiters of io, or as many as so_signal does when all is set
+int signal_io(so_sched_t* s, unsigned int io, unsigned int n, int all) {
+    thread* self = self_in(s);
+
+    // do work
+    lock_instance(s);
+    if (io >= s->core.io) {
+        unlock_instance(s);
+        return -1;
     }
+
+    int threads_signaled = all ? sched_signal(&s->core, io, self->cpu)
+                               : sched_signal_n(&s->core, io, n, self->cpu);
+    schedule_locked(s, self);
+    unlock_instance(s);
+    // end do work
+
     return threads_signaled;
 }
 
+DECL_PREFIX int so_signal(unsigned int io) {
+    return signal_io(here(), io, 0, 1);
+}
+
+DECL_PREFIX int so_sched_signal(so_sched_t *s, unsigned int io) {
+    if (s == NULL) {
+        return -1;
+    }
+    return signal_io(s, io, 0, 1);
+}
+
+DECL_PREFIX int so_signal_n(unsigned int io, unsigned int n) {
+    return signal_io(here(), io, n, 0);
+}
+
+DECL_PREFIX int so_signal_one(unsigned int io) {
+    return signal_io(here(), io, 1, 0);
+}
+
+DECL_PREFIX int so_io_mode(unsigned int io, unsigned int mode) {
+    so_sched_t* s = here();
+
+    if (s == NULL || mode > SO_IO_COUNTING) {
+        return -1;
+    }
+
+    lock_instance(s);
+    if (io >= s->core.io) {
+        unlock_instance(s);
+        return -1;
+    }
+    sched_io_mode(&s->core, io, mode);
+    unlock_instance(s);
+    return 0;
+}
+
 DECL_PREFIX void so_exec(void) {
-    // do work
+    so_sched_t* s = here();
+    thread* self = self_in(s);
 
-    // end do work
+    // most calls neither expire the quantum nor see a higher priority
+    // thread, those never touch the lock; the call counts as inside the
+    // scheduler from the start, so SO_PREEMPT_SIGNAL never stops it there
+    enter_sched();
+    if (sched_charge_fast(&s->core, self)) {
+        leave_sched();
+        return;
+    }
 
-    decrease_quantum();
-    check_scheduler();
-    if (preempted()) {
-        // signal so new running thread can run
-        // if not preempted, no reason to signal since this is running thread
-        pthread_mutex_lock(&sch_mutex);
-        pthread_cond_broadcast(&is_running_thread);
-        pthread_mutex_unlock(&sch_mutex);
+    lock_instance(s);
+    schedule_locked(s, self);
+    unlock_instance(s);
+    leave_sched();
+}
 
-        wait_to_run();
+DECL_PREFIX int so_trace_dump(const char *path) {
+    so_sched_t* s = here();
+    int ret = -1;
+
+    if (s == NULL) {
+        return -1;
+    }
+
+    lock_instance(s);
+    if (s->core.trace != NULL) {
+        ret = trace_dump(s->core.trace, path);
+    }
+    unlock_instance(s);
+    return ret;
+}
+
+DECL_PREFIX int so_get_stats(so_stats_t *stats) {
+    return so_sched_get_stats(here(), stats);
+}
+
+DECL_PREFIX int so_sched_get_stats(so_sched_t *s, so_stats_t *stats) {
+    if (s == NULL) {
+        return -1;
+    }
+
+    lock_instance(s);
+    sched_stats(&s->core, stats);
+    unlock_instance(s);
+    return 0;
+}
+
+DECL_PREFIX int so_get_task_stats(tid_t tid, so_task_stats_t *stats) {
+    so_sched_t* s = here();
+
+    if (s == NULL) {
+        return -1;
+    }
+
+    lock_instance(s);
+    int ret = sched_task_stats(&s->core, tid, stats);
+    unlock_instance(s);
+    return ret;
+}
+
+DECL_PREFIX int so_get_stack_stats(so_handler *func, so_stack_stats_t *stats) {
+    so_sched_t* s = here();
+
+    if (s == NULL) {
+        return -1;
     }
-    return;
+
+    lock_instance(s);
+    int ret = sched_stack_stats(&s->core, func, stats);
+    unlock_instance(s);
+    return ret;
 }
 
 DECL_PREFIX void so_end(void) {
-    if (sch == NULL) {
+    so_sched_destroy(default_sched);
+    default_sched = NULL;
+}
+
+DECL_PREFIX void so_sched_destroy(so_sched_t *s) {
+    if (s == NULL) {
         return;
     }
-    
-    int no_not_terminated;
-    sem_getvalue(&not_terminated_threads, &no_not_terminated);
-    if (no_not_terminated != 0) {
-        sem_wait(&all_threads_terminated);
+    scheduler* sch = &s->core;
+
+    lock_instance(s);
+    while (s->live_tasks != 0) {
+        park_locked(s, s->main_thread);
     }
+    unlock_instance(s);
 
-    for (unsigned int i = 0; i < sch->no_threads; ++i) {
-        pthread_join(sch->terminated_threads[i]->tid, NULL);
-        free(sch->terminated_threads[i]);
+    if (sch->slice_ns != 0) {
+        stop_slice_timer(s);
+    }
+    if (s->poller_on) {
+        fd_poller_stop(&s->poller);
+        fd_poller_destroy(&s->poller);
     }
 
-    free(main_thread);
-    free(sch);
-    sch = NULL;
+    // release the pooled workers and the zombies, they are parked in
+    // wait_for_task()
+    lock_instance(s);
+    sch->shutting_down = 1;
+    for (thread* tr = front(&sch->idle_workers); tr != NULL; tr = tr->next) {
+        unpark(tr);
+    }
+    for (thread* tr = front(&sch->terminated_threads); tr != NULL; tr = tr->next) {
+        unpark(tr);
+    }
+    unlock_instance(s);
 
-    pthread_mutex_destroy(&sch_mutex);
-    pthread_cond_destroy(&is_running_thread);
-    sem_destroy(&not_terminated_threads);
-    sem_destroy(&all_threads_terminated);
+    thread* tr;
+    while ((tr = dequeue(&sch->idle_workers)) != NULL) {
+        enqueue(&sch->terminated_threads, tr);
+    }
+    while ((tr = dequeue(&sch->exited_workers)) != NULL) {
+        enqueue(&sch->terminated_threads, tr);
+    }
+    while ((tr = dequeue(&sch->terminated_threads)) != NULL) {
+        pthread_join(tr->tid, NULL);
+        park_destroy(tr);
+        stack_free(tr->stack, sch->stack_size);
+        tcb_free(&sch->tcbs, tr);
+    }
 
-    return;
-}
\ No newline at end of file
+    park_destroy(s->main_thread);
+    tcb_free(&sch->tcbs, s->main_thread);
+    sched_destroy(sch);
+
+    pthread_mutex_destroy(&s->mutex);
+    free(s);
+}
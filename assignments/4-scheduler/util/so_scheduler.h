@@ -10,10 +10,14 @@
 /* OS dependent stuff */
 #ifdef __linux__
 #include <pthread.h>
+#include <signal.h>
 
 #define DECL_PREFIX
 
 typedef pthread_t tid_t;
+
+/* interrupts a task whose wall clock quantum expired */
+#define SO_PREEMPT_SIGNAL SIGURG
 #elif defined(_WIN32)
 #include <windows.h>
 
@@ -36,6 +40,10 @@ typedef DWORD tid_t;
  * the maximum number of events
  */
 #define SO_MAX_NUM_EVENTS 256
+/*
+ * the maximum number of virtual CPUs
+ */
+#define SO_MAX_CPUS 256
 
 /*
  * return value of failed tasks
@@ -59,6 +67,140 @@ typedef void (so_handler)(unsigned int);
  */
 DECL_PREFIX int so_init(unsigned int time_quantum, unsigned int io);
 
+/*
+ * histogram buckets, bucket i counts latencies below 2^i ns
+ */
+#define SO_STATS_BUCKETS 32
+
+/*
+ * counters of a single task, times are in nanoseconds and only measured
+ * when so_opts_t.stats is set
+ */
+typedef struct so_task_stats {
+	unsigned long long instructions;	/* scheduler calls made */
+	unsigned long long preemptions;		/* quantum expired or higher prio */
+	unsigned long long runs;		/* times it was given a CPU */
+	unsigned long long ready_ns;		/* time spent in ready queues */
+	unsigned long long wait_ns;		/* time spent waiting for io */
+	unsigned long long max_latency_ns;	/* longest ready to run delay */
+	unsigned long long deadline_misses;	/* periods of so_fork_deadline */
+	unsigned long long stack_peak;		/* bytes of stack, see below */
+} so_task_stats_t;
+
+/*
+ * deepest stack use of the tasks running one handler, measured in whole
+ * pages when its tasks finish and only while so_opts_t.stats is set
+ */
+typedef struct so_stack_stats {
+	unsigned long long tasks;	/* finished tasks measured */
+	unsigned long long peak;	/* bytes used by the deepest one */
+	unsigned long long size;	/* bytes of stack of every task */
+} so_stack_stats_t;
+
+/*
+ * counters aggregated over the tasks of one priority level
+ */
+typedef struct so_prio_stats {
+	unsigned long long instructions;
+	unsigned long long preemptions;
+	unsigned long long runs;
+	unsigned long long ready_ns;
+	/* ready to run latency histogram */
+	unsigned long long latency_hist[SO_STATS_BUCKETS];
+} so_prio_stats_t;
+
+typedef struct so_stats {
+	unsigned long long forks;
+	unsigned long long switches;
+	unsigned long long preemptions;
+	/* periods a deadline task ended without waiting for io */
+	unsigned long long deadline_misses;
+	/* recorded switches and signals a SO_REPLAY run could not repeat */
+	unsigned long long replay_misses;
+	/* waits on each io device and the time spent waiting */
+	unsigned long long io_waits[SO_MAX_NUM_EVENTS];
+	unsigned long long io_wait_ns[SO_MAX_NUM_EVENTS];
+	so_prio_stats_t prio[SO_MAX_PRIO + 1];
+} so_stats_t;
+
+/*
+ * units of time_quantum, see so_opts_t.slice
+ */
+#define SO_SLICE_CALLS	0	/* scheduler calls made by the task */
+#define SO_SLICE_US	1	/* microseconds of wall clock time */
+
+/*
+ * scheduling policies, see so_opts_t.policy
+ */
+#define SO_POLICY_PRIO	0	/* strict priority round robin */
+#define SO_POLICY_MLFQ	1	/* feedback queue, demotes CPU bound tasks */
+#define SO_POLICY_FAIR	2	/* CPU share weighted by priority */
+
+/*
+ * optional scheduler settings, a zero field keeps the default behavior
+ */
+typedef struct so_opts {
+	/*
+	 * finished tasks kept alive to run the handlers of later forks, a
+	 * task joins the pool once it is detached or joined
+	 */
+	unsigned int pool_size;
+	/*
+	 * virtual CPUs running tasks in parallel, each one with its own
+	 * ready queues; an idle CPU steals from the others
+	 */
+	unsigned int ncpus;
+	/*
+	 * scheduling events kept in the trace ring, 0 turns tracing off
+	 * unless the SO_TRACE=<file> environment variable is set, in which
+	 * case the trace is also written to <file> by so_end
+	 */
+	unsigned int trace_events;
+	/* measure the ready, wait and latency times of so_stats_t */
+	unsigned int stats;
+	/*
+	 * SO_SLICE_US measures the quantum with a timer, an expired task is
+	 * preempted at its next scheduler call
+	 */
+	unsigned int slice;
+	/*
+	 * with SO_SLICE_US, also preempt a task that makes no scheduler
+	 * calls by interrupting it with SO_PREEMPT_SIGNAL; its handler must
+	 * not be holding locks, including the ones of malloc or stdio
+	 */
+	unsigned int async_preempt;
+	/*
+	 * SO_POLICY_MLFQ lowers the priority of a task each time it uses up
+	 * its quantum and raises it for every 4 quanta it waits ready;
+	 * SO_POLICY_FAIR gives every task a share of the CPU that grows with
+	 * its priority; with both, a low priority task never starves
+	 */
+	unsigned int policy;
+	/*
+	 * tasks start detached, see so_detach; a long running process that
+	 * never joins its tasks keeps a constant footprint this way
+	 */
+	unsigned int detach;
+	/*
+	 * bytes of stack of each task, rounded up to whole pages, with a
+	 * guard page below it that faults on overflow; 0 keeps the default
+	 * of 8 MB for the thread backend and 256 KB for the green one;
+	 * stacks are only backed by memory once touched and a finished task
+	 * hands its stack to the next fork
+	 */
+	unsigned long stack_size;
+} so_opts_t;
+
+/*
+ * creates and initializes scheduler with extra settings
+ * + time quantum for each thread
+ * + number of IO devices supported
+ * + settings, NULL is the same as so_init
+ * returns: 0 on success or negative on error
+ */
+DECL_PREFIX int so_init_ex(unsigned int time_quantum, unsigned int io,
+			   const so_opts_t *opts);
+
 /*
  * creates a new so_task_t and runs it according to the scheduler
  * + handler function
@@ -67,6 +209,65 @@ DECL_PREFIX int so_init(unsigned int time_quantum, unsigned int io);
  */
 DECL_PREFIX tid_t so_fork(so_handler *func, unsigned int priority);
 
+/*
+ * creates n tasks at once: they are all queued before any of them runs
+ * and the caller is charged and may be preempted once, as by one so_fork
+ * + handler function of each task
+ * + priority of each task
+ * + number of tasks
+ * + tid of each task, INVALID_TID if it could not be created; may be NULL
+ * returns: the number of tasks created or -1 if a handler or a priority
+ * is invalid, in which case none is created
+ */
+DECL_PREFIX int so_fork_many(so_handler *const *funcs, const unsigned int *prios,
+			     unsigned int n, tid_t *tids_out);
+
+/*
+ * the share of the CPUs, in percent, that deadline tasks can reserve
+ */
+#define SO_DEADLINE_MAX_UTIL 90
+
+/*
+ * creates a new task scheduled earliest deadline first, ahead of the
+ * tasks of so_fork; in every period it may run for budget time units and
+ * should be waiting for an IO device again when the period ends,
+ * otherwise the period is counted as a deadline miss; time units are
+ * those of the quantum, calls of the scheduler or microseconds
+ * + handler function, called with SO_MAX_PRIO
+ * + period
+ * + budget, at most the period
+ * returns: tid of the new task if it is admitted or INVALID_TID if the
+ * deadline tasks would reserve more than SO_DEADLINE_MAX_UTIL
+ */
+DECL_PREFIX tid_t so_fork_deadline(so_handler *func, unsigned int period,
+				   unsigned int budget);
+
+/*
+ * waits until a task finishes, its resources are released after that;
+ * other tasks run meanwhile, a task that never finishes blocks the caller
+ * + tid returned by so_fork
+ * returns: 0 on success or -1 if the task does not exist, is detached,
+ * was already joined or is the caller
+ */
+DECL_PREFIX int so_join(tid_t tid);
+
+/*
+ * lets a task release its resources as soon as its handler returns, or
+ * right away if it already did; it can no longer be joined
+ * + tid returned by so_fork
+ * returns: 0 on success or -1 if the task does not exist, is detached or
+ * was already joined
+ */
+DECL_PREFIX int so_detach(tid_t tid);
+
+/*
+ * identifies the caller; tasks of the green backend share a kernel
+ * thread, so use this rather than pthread_self() to tell them apart
+ * returns: tid so_fork returned for the calling task, or the id of the
+ * calling thread outside of any task
+ */
+DECL_PREFIX tid_t so_self(void);
+
 /*
  * waits for an IO device
  * + device index
@@ -74,6 +275,38 @@ DECL_PREFIX tid_t so_fork(so_handler *func, unsigned int priority);
  */
 DECL_PREFIX int so_wait(unsigned int io);
 
+/*
+ * waits for an IO device, giving up after a number of time units
+ * + device index
+ * + time units, see so_sleep; 0 only takes a signal kept by a counting
+ *   device
+ * returns: 0 if signaled, 1 if the time passed first or -1 if the device
+ * does not exist
+ */
+DECL_PREFIX int so_wait_timeout(unsigned int io, unsigned int units);
+
+/*
+ * puts the calling task to sleep while the others run
+ * + time units, those of the quantum: calls of the scheduler made by all
+ *   the tasks, or microseconds with SO_SLICE_US; a task wakes up at the
+ *   first scheduling decision after its time, and the call count skips
+ *   ahead while every task sleeps
+ * returns: 0 on success or -1 if there is no scheduler
+ */
+DECL_PREFIX int so_sleep(unsigned int units);
+
+/*
+ * waits until a file descriptor is ready while the other tasks run; the
+ * thread backend watches the descriptors from a poller thread, the green
+ * one whenever a quantum ends or no task is ready
+ * + file descriptor: a socket, pipe or anything else epoll accepts, that
+ *   no other task waits for
+ * + POLLIN and/or POLLOUT
+ * returns: the ready events, POLLHUP or POLLERR included, or -1 if the
+ * descriptor cannot be waited for
+ */
+DECL_PREFIX int so_wait_fd(int fd, unsigned int events);
+
 /*
  * signals an IO device
  * + device index
@@ -81,6 +314,37 @@ DECL_PREFIX int so_wait(unsigned int io);
  */
 DECL_PREFIX int so_signal(unsigned int io);
 
+/*
+ * signals an IO device, waking at most n tasks, highest priority first
+ * + device index
+ * + maximum number of tasks to wake
+ * return the number of tasks woke or -1 on error
+ */
+DECL_PREFIX int so_signal_n(unsigned int io, unsigned int n);
+
+/*
+ * signals an IO device, waking its highest priority waiting task
+ * + device index
+ * return the number of tasks woke or -1 on error
+ */
+DECL_PREFIX int so_signal_one(unsigned int io);
+
+/*
+ * io device modes, see so_io_mode
+ */
+#define SO_IO_BROADCAST	0	/* so_signal wakes every waiting task */
+#define SO_IO_COUNTING	1	/* the device counts like a semaphore */
+
+/*
+ * changes how an IO device is signaled; on a counting device so_signal
+ * wakes one task, signals nobody waited for are kept and each one lets a
+ * later so_wait through without blocking
+ * + device index
+ * + SO_IO_BROADCAST or SO_IO_COUNTING
+ * returns: 0 on success or -1 on error
+ */
+DECL_PREFIX int so_io_mode(unsigned int io, unsigned int mode);
+
 /*
  * does whatever operation
  */
@@ -91,6 +355,99 @@ DECL_PREFIX void so_exec(void);
  */
 DECL_PREFIX void so_end(void);
 
+/*
+ * independent scheduler instance; the calls without a handle act on the
+ * scheduler of the calling task, or on the one of so_init when called
+ * from outside any task
+ */
+typedef struct so_sched so_sched_t;
+
+/*
+ * creates a scheduler next to the one of so_init, with its own tasks,
+ * ready queues and lock; its tasks never run on behalf of another one
+ * + same arguments as so_init_ex
+ * returns: the new scheduler or NULL on error
+ */
+DECL_PREFIX so_sched_t *so_sched_create(unsigned int time_quantum,
+					unsigned int io, const so_opts_t *opts);
+
+/*
+ * so_fork on a given scheduler, from inside or outside of its tasks; a
+ * call from outside never preempts the running task on the spot, the new
+ * task takes an idle CPU or waits for the next scheduler call of the
+ * task it should preempt
+ * + scheduler returned by so_sched_create
+ * + handler function
+ * + priority
+ * returns: tid of the new task if successful or INVALID_TID
+ */
+DECL_PREFIX tid_t so_sched_fork(so_sched_t *s, so_handler *func,
+				unsigned int priority);
+
+/*
+ * so_signal on a given scheduler, from inside or outside of its tasks,
+ * woken tasks start as those of so_sched_fork do
+ * + scheduler returned by so_sched_create
+ * + device index
+ * return the number of tasks woke or -1 on error
+ */
+DECL_PREFIX int so_sched_signal(so_sched_t *s, unsigned int io);
+
+/*
+ * so_get_stats of a given scheduler
+ * + scheduler returned by so_sched_create
+ * + output structure
+ * returns: 0 on success or -1 on error
+ */
+DECL_PREFIX int so_sched_get_stats(so_sched_t *s, so_stats_t *stats);
+
+/*
+ * so_end of a given scheduler: waits for its tasks and releases it
+ * + scheduler returned by so_sched_create
+ */
+DECL_PREFIX void so_sched_destroy(so_sched_t *s);
+
+/*
+ * copies the scheduler wide counters
+ * + output structure
+ * returns: 0 on success or -1 if there is no scheduler
+ */
+DECL_PREFIX int so_get_stats(so_stats_t *stats);
+
+/*
+ * copies the counters of a task
+ * + tid returned by so_fork
+ * + output structure
+ * returns: 0 on success or -1 if the task does not exist
+ */
+DECL_PREFIX int so_get_task_stats(tid_t tid, so_task_stats_t *stats);
+
+/*
+ * copies the stack use of the tasks running a handler, to right-size
+ * so_opts_t.stack_size
+ * + handler function given to so_fork
+ * + output structure
+ * returns: 0 on success or -1 if no task of the handler was measured
+ */
+DECL_PREFIX int so_get_stack_stats(so_handler *func, so_stack_stats_t *stats);
+
+/*
+ * writes the recorded scheduling events in Chrome trace / Perfetto format
+ * + output file
+ * returns: 0 on success or -1 if tracing is off or the file fails
+ */
+DECL_PREFIX int so_trace_dump(const char *path);
+
+/*
+ * record and replay: with SO_RECORD=<file> in the environment so_end
+ * writes every context switch and signal to <file>; a later run with
+ * SO_REPLAY=<file> switches tasks at the same scheduler calls, whatever
+ * the wall clock quantum or the timing of other kernel threads do, so a
+ * changed handler can be measured under the same schedule as long as it
+ * makes the same scheduler calls; each virtual CPU follows its own
+ * records, see so_stats_t.replay_misses
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,714 @@
+// Green thread backend: every task is a ucontext on its own mmap'd stack
+// and all of them share the kernel thread that created their scheduler.
+// Switches never enter the kernel scheduler, the main thread acts as the
+// idle task and gets the CPU back once no task is ready. A kernel thread
+// hosts at most one scheduler, so the state of the running one is kept
+// per kernel thread.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include "types.h"
+#include "task_queue.h"
+#include "sched_core.h"
+#include "sched_deadline.h"
+#include "task_table.h"
+#include "tcb_slab.h"
+#include "task_stack.h"
+#include "fd_poller.h"
+#include "trace.h"
+#include "slice_timer.h"
+#include "sched_clock.h"
+
+struct so_sched {
+    scheduler core;
+    thread* main_thread;
+    // kernel thread that owns the scheduler
+    pthread_t kernel_thread;
+    // set when the task the main thread joins is done, see so_join
+    int main_joined;
+    // wall clock quantum, see so_opts_t.slice
+    slice_timer timer;
+    // so_wait_fd, created with the first wait; the descriptors are
+    // polled when a quantum ends and waited for while the CPU is idle
+    fd_poller poller;
+    int poller_on;
+};
+
+// the instance of so_init
+static so_sched_t* default_sched = NULL;
+// scheduler owned by the calling kernel thread and the task it runs
+static __thread so_sched_t* active TLS_FAST;
+static __thread thread* current TLS_FAST;
+// set while the scheduler runs, SO_PREEMPT_SIGNAL is ignored there
+static __thread volatile sig_atomic_t in_sched TLS_FAST;
+// task ids are never reused, unlike the addresses of finished tasks
+static tid_t last_tid;
+// SO_PREEMPT_SIGNAL is handled while an instance has a wall clock quantum
+static pthread_mutex_t preempt_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int preempt_users;
+static struct sigaction old_preempt_action;
+
+static void  free_thread(thread* tr);
+static void  task_entry(void);
+static void  switch_to_running(void);
+static int   start_slice_timer(so_sched_t* s);
+static void  stop_slice_timer(so_sched_t* s);
+static int   run_next_event(void);
+static void  fd_ready(void* arg, thread* tr, unsigned int events);
+static int   signal_io(unsigned int io, unsigned int n, int all);
+static thread* new_task(so_handler* func, unsigned int priority,
+                        unsigned int period, unsigned int budget);
+static tid_t fork_task(so_handler* func, unsigned int priority,
+                       unsigned int period, unsigned int budget);
+
+DECL_PREFIX int so_init(unsigned int time_quantum, unsigned int io) {
+    return so_init_ex(time_quantum, io, NULL);
+}
+
+DECL_PREFIX int so_init_ex(unsigned int time_quantum, unsigned int io,
+                           const so_opts_t *opts) {
+    if (default_sched != NULL) {
+        return -1;
+    }
+
+    default_sched = so_sched_create(time_quantum, io, opts);
+    return default_sched != NULL ? 0 : -1;
+}
+
+DECL_PREFIX so_sched_t *so_sched_create(unsigned int time_quantum, unsigned int io,
+                                        const so_opts_t *opts) {
+    // the worker pool does not apply, tasks own no kernel thread, and all
+    // the tasks share a single CPU
+    if (opts != NULL && opts->ncpus > 1) {
+        return NULL;
+    }
+
+    if (time_quantum == 0) {
+        return NULL;
+    }
+
+    if (io > SO_MAX_NUM_EVENTS) {
+        return NULL;
+    }
+
+    if (active != NULL) {
+        return NULL;
+    }
+
+    so_sched_t* s = calloc(1, sizeof(*s));
+
+    if (s == NULL) {
+        return NULL;
+    }
+    scheduler* sch = &s->core;
+
+    s->main_thread = tcb_alloc(&sch->tcbs);
+    if (s->main_thread == NULL || sched_init(sch, time_quantum, io, opts, s->main_thread) < 0) {
+        tcb_slab_destroy(&sch->tcbs);
+        free(s);
+        return NULL;
+    }
+    s->kernel_thread = pthread_self();
+    s->main_thread->tid = s->kernel_thread;
+    sch->main_idles = 1;
+    active = s;
+    current = s->main_thread;
+    in_sched = 0;
+
+    if (sch->slice_ns != 0 && start_slice_timer(s) < 0) {
+        sch->slice_ns = 0;
+        so_sched_destroy(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+// all the tasks share the kernel thread, so the timer thread interrupts
+// it on every tick and the signal handler checks the quantum
+static void slice_tick(void* arg) {
+    so_sched_t* s = arg;
+
+    pthread_kill(s->kernel_thread, SO_PREEMPT_SIGNAL);
+}
+
+// runs on the kernel thread on top of the interrupted task, switching
+// away from here resumes it when the task is picked again
+static void preempt_signal(int sig) {
+    (void)sig;
+    if (in_sched || active == NULL) {
+        return;
+    }
+
+    int saved_errno = errno;
+    scheduler* sch = &active->core;
+    in_sched = 1;
+    sched_expire(sch);
+    if (sched_tick(sch, 0, now_ns()) && sch->async_preempt && current != active->main_thread) {
+        sched_pick(sch, 0);
+        switch_to_running();
+    }
+    in_sched = 0;
+    errno = saved_errno;
+}
+
+// the signal handler is shared by the instances, the first one installs
+// it and the last one puts the old handler back
+static int hold_preempt_signal(void) {
+    int ret = 0;
+
+    pthread_mutex_lock(&preempt_lock);
+    if (preempt_users == 0) {
+        struct sigaction sa = {0};
+        sa.sa_handler = preempt_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        ret = sigaction(SO_PREEMPT_SIGNAL, &sa, &old_preempt_action);
+    }
+    if (ret == 0) {
+        ++preempt_users;
+    }
+    pthread_mutex_unlock(&preempt_lock);
+    return ret;
+}
+
+static void release_preempt_signal(void) {
+    pthread_mutex_lock(&preempt_lock);
+    if (--preempt_users == 0) {
+        sigaction(SO_PREEMPT_SIGNAL, &old_preempt_action, NULL);
+    }
+    pthread_mutex_unlock(&preempt_lock);
+}
+
+// the timer ticks four times per quantum, so a slice runs at most a
+// quarter of the quantum too long
+static int start_slice_timer(so_sched_t* s) {
+    unsigned long long period = s->core.slice_ns / 4;
+
+    if (hold_preempt_signal() < 0) {
+        return -1;
+    }
+    if (slice_timer_start(&s->timer, period > 0 ? period : 1, slice_tick, s) < 0) {
+        release_preempt_signal();
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_slice_timer(so_sched_t* s) {
+    slice_timer_stop(&s->timer);
+    release_preempt_signal();
+}
+
+static void free_thread(thread* tr) {
+    stack_free(tr->stack, active->core.stack_size);
+    tcb_free(&active->core.tcbs, tr);
+}
+
+static void task_entry(void) {
+    thread* tr = current;
+    so_sched_t* s = active;
+    scheduler* sch = &s->core;
+
+    in_sched = 0;
+    tr->func(tr->priority);
+    in_sched = 1;
+    tr->work_done = 1;
+    if (sch->stats_on) {
+        sched_stack_peak(sch, tr, stack_peak(tr->stack, sch->stack_size));
+    }
+
+    sched_pick(sch, 0);
+    if (tr->joiner == s->main_thread) {
+        s->main_joined = 1;
+    }
+    // the stack of a reclaimed task is kept for the next fork
+    if (tr->detached || tr->joiner != NULL) {
+        enqueue(&sch->idle_workers, tr);
+    }
+    else {
+        tr->zombie = 1;
+        enqueue(&sch->terminated_threads, tr);
+    }
+    switch_to_running();
+}
+
+// saves the calling task and resumes the running thread of the CPU, or
+// the main thread when the CPU went idle
+static void switch_to_running(void) {
+    scheduler* sch = &active->core;
+    thread* prev = current;
+    thread* next = sch->cpus[0].running;
+
+    if (next == prev) {
+        return;
+    }
+
+    if (next == NULL) {
+        next = active->main_thread;
+        sched_dispatch(sch, 0, next);
+        sch->main_thread_running = 1;
+    }
+
+    current = next;
+    swapcontext(&prev->ctx, &next->ctx);
+}
+
+DECL_PREFIX tid_t so_fork(so_handler *func, unsigned int priority) {
+    return so_sched_fork(active, func, priority);
+}
+
+// tasks only run on the kernel thread of their scheduler
+DECL_PREFIX tid_t so_sched_fork(so_sched_t *s, so_handler *func,
+                                unsigned int priority) {
+    if (s == NULL || s != active || func == 0) {
+        return INVALID_TID;
+    }
+
+    if (priority > SO_MAX_PRIO) {
+        return INVALID_TID;
+    }
+
+    return fork_task(func, priority, 0, 0);
+}
+
+DECL_PREFIX tid_t so_fork_deadline(so_handler *func, unsigned int period,
+                                   unsigned int budget) {
+    if (func == 0 || active == NULL) {
+        return INVALID_TID;
+    }
+
+    in_sched = 1;
+    int admitted = edf_admit(&active->core, period, budget);
+    in_sched = 0;
+    if (admitted < 0) {
+        return INVALID_TID;
+    }
+
+    tid_t tid = fork_task(func, SO_MAX_PRIO, period, budget);
+    if (tid == INVALID_TID) {
+        edf_release(&active->core, period, budget);
+    }
+    return tid;
+}
+
+// a period of 0 makes a task of the scheduling policy, anything else a
+// deadline task whose share is already reserved; the task is queued but
+// the caller is not charged
+// returns NULL if there is no memory
+static thread* new_task(so_handler* func, unsigned int priority,
+                        unsigned int period, unsigned int budget) {
+    scheduler* sch = &active->core;
+
+    // finished tasks keep their stack for the next fork
+    thread* tr = dequeue(&sch->idle_workers);
+    if (tr == NULL) {
+        tr = tcb_alloc(&sch->tcbs);
+        if (tr == NULL) {
+            return NULL;
+        }
+        tr->stack = stack_alloc(sch->stack_size);
+        if (tr->stack == NULL) {
+            tcb_free(&sch->tcbs, tr);
+            return NULL;
+        }
+    }
+    tr->time_quantum = sch->time_quantum;
+    tr->priority = priority;
+    tr->edf = period != 0;
+    tr->period = period;
+    tr->budget = budget;
+    tr->func = func;
+    tr->work_done = 0;
+    tr->waiting = 0;
+    tr->detached = sch->detach_all;
+    tr->joiner = NULL;
+    // the tid table is keyed by the old tid of a reused task
+    table_remove(&sch->tasks, tr);
+    tr->tid = __atomic_add_fetch(&last_tid, 1, __ATOMIC_RELAXED);
+
+    getcontext(&tr->ctx);
+    tr->ctx.uc_stack.ss_sp = tr->stack;
+    tr->ctx.uc_stack.ss_size = sch->stack_size;
+    tr->ctx.uc_link = NULL;
+    makecontext(&tr->ctx, task_entry, 0);
+
+    sched_fork(sch, tr);
+    return tr;
+}
+
+static tid_t fork_task(so_handler* func, unsigned int priority,
+                       unsigned int period, unsigned int budget) {
+    scheduler* sch = &active->core;
+
+    in_sched = 1;
+    thread* tr = new_task(func, priority, period, budget);
+    if (tr == NULL) {
+        in_sched = 0;
+        return INVALID_TID;
+    }
+
+    tid_t tid = tr->tid;
+    sched_charge(sch, current);
+    sched_pick(sch, 0);
+    switch_to_running();
+    in_sched = 0;
+
+    return tid;
+}
+
+// every task is queued before the caller is charged and may switch
+DECL_PREFIX int so_fork_many(so_handler *const *funcs, const unsigned int *prios,
+                             unsigned int n, tid_t *tids_out) {
+    if (active == NULL || funcs == NULL || prios == NULL) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < n; ++i) {
+        if (funcs[i] == 0 || prios[i] > SO_MAX_PRIO) {
+            return -1;
+        }
+    }
+
+    scheduler* sch = &active->core;
+    int created = 0;
+
+    in_sched = 1;
+    for (unsigned int i = 0; i < n; ++i) {
+        thread* tr = new_task(funcs[i], prios[i], 0, 0);
+        if (tids_out != NULL) {
+            tids_out[i] = tr != NULL ? tr->tid : INVALID_TID;
+        }
+        created += tr != NULL;
+    }
+    if (created > 0) {
+        sched_charge(sch, current);
+        sched_pick(sch, 0);
+        switch_to_running();
+    }
+    in_sched = 0;
+
+    return created;
+}
+
+static void fd_ready(void* arg, thread* tr, unsigned int events) {
+    sched_fd_ready(arg, tr, events);
+}
+
+// lets the main thread, which runs only while no task is ready, wait for
+// the next timeout of a sleeping task or the next ready descriptor and
+// run whatever became ready
+// returns 0 if no task sleeps or waits for a descriptor
+static int run_next_event(void) {
+    scheduler* sch = &active->core;
+    unsigned long long ns = 0;
+    int timers = sched_timer_delay(sch, &ns);
+
+    if (!timers && sch->fd_waiters == 0) {
+        return 0;
+    }
+    if (sch->fd_waiters != 0) {
+        // rounded up to whole milliseconds, -1 waits for a descriptor
+        int ms = timers ? (int)((ns + 999999) / 1000000) : -1;
+        fd_poller_wait(&active->poller, ms, fd_ready, sch);
+    }
+    else if (ns != 0) {
+        struct timespec ts = { ns / 1000000000ULL, ns % 1000000000ULL };
+        nanosleep(&ts, NULL);
+    }
+    sched_expire(sch);
+    sched_pick(sch, 0);
+    switch_to_running();
+    return 1;
+}
+
+// the task the main thread joins can only finish after a timeout
+static int main_join(void) {
+    active->main_joined = 0;
+    while (!active->main_joined && run_next_event()) {
+    }
+    return active->main_joined ? 0 : -1;
+}
+
+DECL_PREFIX int so_join(tid_t tid) {
+    if (active == NULL) {
+        return -1;
+    }
+    scheduler* sch = &active->core;
+
+    thread* tr = table_find(&sch->tasks, tid);
+    if (tr == NULL || tr == current || tr->detached || tr->joiner != NULL) {
+        return -1;
+    }
+
+    int ret = 0;
+    in_sched = 1;
+    tr->joiner = current;
+    if (tr->zombie) {
+        tr->zombie = 0;
+        remove_from_queue(&sch->terminated_threads, tr);
+        enqueue(&sch->idle_workers, tr);
+    }
+    else if (current == active->main_thread) {
+        ret = main_join();
+        if (ret < 0) {
+            // every task left waits for an io device, tr never finishes
+            tr->joiner = NULL;
+        }
+    }
+    else {
+        sched_join(sch, current, tr);
+        sched_charge(sch, current);
+        sched_pick(sch, 0);
+        switch_to_running();
+    }
+    in_sched = 0;
+    return ret;
+}
+
+DECL_PREFIX int so_detach(tid_t tid) {
+    if (active == NULL) {
+        return -1;
+    }
+    scheduler* sch = &active->core;
+
+    thread* tr = table_find(&sch->tasks, tid);
+    if (tr == NULL || tr->detached || tr->joiner != NULL) {
+        return -1;
+    }
+    tr->detached = 1;
+    if (tr->zombie) {
+        tr->zombie = 0;
+        remove_from_queue(&sch->terminated_threads, tr);
+        enqueue(&sch->idle_workers, tr);
+    }
+    return 0;
+}
+
+// all the tasks run on the kernel thread of their scheduler, so tasks
+// are told apart by the tid so_fork returned
+DECL_PREFIX tid_t so_self(void) {
+    return current != NULL ? current->tid : pthread_self();
+}
+
+DECL_PREFIX int so_wait(unsigned int io) {
+    scheduler* sch = &active->core;
+
+    if (io >= sch->io) {
+        return -1;
+    }
+
+    in_sched = 1;
+    sched_wait(sch, current, io);
+    sched_charge(sch, current);
+    sched_pick(sch, 0);
+    switch_to_running();
+    in_sched = 0;
+    return 0;
+}
+
+DECL_PREFIX int so_wait_timeout(unsigned int io, unsigned int units) {
+    scheduler* sch = &active->core;
+
+    if (io >= sch->io) {
+        return -1;
+    }
+
+    in_sched = 1;
+    sched_wait_timeout(sch, current, io, units);
+    sched_charge(sch, current);
+    sched_pick(sch, 0);
+    switch_to_running();
+    in_sched = 0;
+    return current->timed_out;
+}
+
+DECL_PREFIX int so_sleep(unsigned int units) {
+    if (active == NULL) {
+        return -1;
+    }
+    scheduler* sch = &active->core;
+
+    in_sched = 1;
+    sched_sleep(sch, current, units);
+    sched_charge(sch, current);
+    sched_pick(sch, 0);
+    switch_to_running();
+    in_sched = 0;
+    return 0;
+}
+
+DECL_PREFIX int so_wait_fd(int fd, unsigned int events) {
+    if (active == NULL) {
+        return -1;
+    }
+    so_sched_t* s = active;
+
+    // the main thread only runs while no task is ready, it simply blocks
+    if (current == s->main_thread) {
+        struct pollfd pfd = { .fd = fd, .events = events };
+        return poll(&pfd, 1, -1) < 0 ? -1 : (unsigned short)pfd.revents;
+    }
+
+    if (!s->poller_on) {
+        if (fd_poller_init(&s->poller) < 0) {
+            return -1;
+        }
+        s->poller_on = 1;
+    }
+    if (fd_poller_add(&s->poller, current, fd, events) < 0) {
+        return -1;
+    }
+
+    in_sched = 1;
+    sched_wait_fd(&s->core, current, fd);
+    sched_charge(&s->core, current);
+    sched_pick(&s->core, 0);
+    switch_to_running();
+    in_sched = 0;
+    return current->fd_events;
+}
+
+// wakes n waiters of io, or as many as so_signal does when all is set
+static int signal_io(unsigned int io, unsigned int n, int all) {
+    scheduler* sch = &active->core;
+
+    if (io >= sch->io) {
+        return -1;
+    }
+
+    in_sched = 1;
+    int threads_signaled = all ? sched_signal(sch, io, 0) : sched_signal_n(sch, io, n, 0);
+    sched_charge(sch, current);
+    sched_pick(sch, 0);
+    switch_to_running();
+    in_sched = 0;
+    return threads_signaled;
+}
+
+DECL_PREFIX int so_signal(unsigned int io) {
+    return signal_io(io, 0, 1);
+}
+
+DECL_PREFIX int so_sched_signal(so_sched_t *s, unsigned int io) {
+    if (s == NULL || s != active) {
+        return -1;
+    }
+    return signal_io(io, 0, 1);
+}
+
+DECL_PREFIX int so_signal_n(unsigned int io, unsigned int n) {
+    return signal_io(io, n, 0);
+}
+
+DECL_PREFIX int so_signal_one(unsigned int io) {
+    return signal_io(io, 1, 0);
+}
+
+DECL_PREFIX int so_io_mode(unsigned int io, unsigned int mode) {
+    if (active == NULL || io >= active->core.io || mode > SO_IO_COUNTING) {
+        return -1;
+    }
+    sched_io_mode(&active->core, io, mode);
+    return 0;
+}
+
+DECL_PREFIX void so_exec(void) {
+    scheduler* sch = &active->core;
+
+    in_sched = 1;
+    if (!sched_charge_fast(sch, current)) {
+        sched_charge(sch, current);
+        if (sch->fd_waiters != 0) {
+            fd_poller_wait(&active->poller, 0, fd_ready, sch);
+        }
+        sched_pick(sch, 0);
+        switch_to_running();
+    }
+    in_sched = 0;
+}
+
+DECL_PREFIX int so_trace_dump(const char *path) {
+    if (active == NULL || active->core.trace == NULL) {
+        return -1;
+    }
+    return trace_dump(active->core.trace, path);
+}
+
+DECL_PREFIX int so_get_stats(so_stats_t *stats) {
+    return so_sched_get_stats(active, stats);
+}
+
+// the counters change while the owner kernel thread runs its tasks
+DECL_PREFIX int so_sched_get_stats(so_sched_t *s, so_stats_t *stats) {
+    if (s == NULL || s != active) {
+        return -1;
+    }
+    sched_stats(&s->core, stats);
+    return 0;
+}
+
+DECL_PREFIX int so_get_task_stats(tid_t tid, so_task_stats_t *stats) {
+    if (active == NULL) {
+        return -1;
+    }
+    return sched_task_stats(&active->core, tid, stats);
+}
+
+DECL_PREFIX int so_get_stack_stats(so_handler *func, so_stack_stats_t *stats) {
+    if (active == NULL) {
+        return -1;
+    }
+    return sched_stack_stats(&active->core, func, stats);
+}
+
+DECL_PREFIX void so_end(void) {
+    if (default_sched == NULL || default_sched != active) {
+        return;
+    }
+    so_sched_destroy(default_sched);
+    default_sched = NULL;
+}
+
+DECL_PREFIX void so_sched_destroy(so_sched_t *s) {
+    if (s == NULL || s != active) {
+        return;
+    }
+    scheduler* sch = &s->core;
+
+    in_sched = 1;
+
+    // the main thread only runs again when no task is ready, tasks that
+    // sleep run again once their time comes
+    while (run_next_event()) {
+    }
+
+    if (sch->slice_ns != 0) {
+        stop_slice_timer(s);
+    }
+    if (s->poller_on) {
+        fd_poller_destroy(&s->poller);
+    }
+
+    // whatever is left is waiting for an io device that will never be
+    // signaled
+    thread* tr;
+    while ((tr = dequeue(&sch->idle_workers)) != NULL) {
+        free_thread(tr);
+    }
+    while ((tr = dequeue(&sch->terminated_threads)) != NULL) {
+        free_thread(tr);
+    }
+    for (unsigned int i = 0; i < sch->io; ++i) {
+        while ((tr = wait_pop(&sch->devices[i])) != NULL) {
+            free_thread(tr);
+        }
+    }
+
+    tcb_free(&sch->tcbs, s->main_thread);
+    sched_destroy(sch);
+    free(s);
+    active = NULL;
+    current = NULL;
+}
@@ -0,0 +1,73 @@
+// FIFO of threads linked through the prev / next fields of each thread,
+// a thread can be part of a single queue at a time
+#include "types.h"
+#include "task_queue.h"
+
+void init_queue(T_Queue* q)
+{
+    q->head = NULL;
+    q->tail = NULL;
+    q->no_elem = 0;
+}
+
+int is_empty(T_Queue* q)
+{
+    return q->no_elem == 0;
+}
+
+void enqueue(T_Queue* q, thread* tr)
+{
+    tr->next = NULL;
+    tr->prev = q->tail;
+
+    if (q->tail != NULL) {
+        q->tail->next = tr;
+    }
+    else {
+        q->head = tr;
+    }
+    q->tail = tr;
+    ++q->no_elem;
+}
+
+thread* dequeue(T_Queue* q)
+{
+    thread* tr = q->head;
+
+    if (tr != NULL) {
+        remove_from_queue(q, tr);
+    }
+    return tr;
+}
+
+// unlinks a thread from anywhere inside the queue
+void remove_from_queue(T_Queue* q, thread* tr)
+{
+    if (tr->prev != NULL) {
+        tr->prev->next = tr->next;
+    }
+    else {
+        q->head = tr->next;
+    }
+
+    if (tr->next != NULL) {
+        tr->next->prev = tr->prev;
+    }
+    else {
+        q->tail = tr->prev;
+    }
+
+    tr->prev = NULL;
+    tr->next = NULL;
+    --q->no_elem;
+}
+
+thread* front(T_Queue* q)
+{
+    return q->head;
+}
+
+thread* rear(T_Queue* q)
+{
+    return q->tail;
+}
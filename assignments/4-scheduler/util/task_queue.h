@@ -0,0 +1,19 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+#include "types.h"
+
+void init_queue(T_Queue* q);
+
+int is_empty(T_Queue* q);
+
+void enqueue(T_Queue* q, thread* tr);
+
+thread* dequeue(T_Queue* q);
+
+void remove_from_queue(T_Queue* q, thread* tr);
+
+thread* front(T_Queue* q);
+
+thread* rear(T_Queue* q);
+
+#endif
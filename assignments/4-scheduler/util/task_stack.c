@@ -0,0 +1,83 @@
+// Task stacks mapped on demand, each with a guard page right below it so
+// an overflow faults instead of running into the next stack. Pages are
+// only backed once touched, which is also how the peak usage is found:
+// the lowest resident page is as deep as any handler went.
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <unistd.h>
+#include "task_stack.h"
+
+// pages checked by one mincore call
+#define SCAN_PAGES 256
+
+static size_t page_size(void)
+{
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// so_opts_t.stack_size rounded up to whole pages
+size_t stack_size(const so_opts_t* opts)
+{
+    size_t page = page_size();
+    size_t size = opts != NULL && opts->stack_size != 0 ? opts->stack_size
+                                                        : STACK_DEFAULT_SIZE;
+    if (size < STACK_MIN_SIZE) {
+        size = STACK_MIN_SIZE;
+    }
+    return (size + page - 1) & ~(page - 1);
+}
+
+// returns the lowest usable address of a stack of size bytes, or NULL
+void* stack_alloc(size_t size)
+{
+    size_t page = page_size();
+    char* map = mmap(NULL, size + page, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (mprotect(map, page, PROT_NONE) < 0) {
+        munmap(map, size + page);
+        return NULL;
+    }
+    return map + page;
+}
+
+void stack_free(void* stack, size_t size)
+{
+    size_t page = page_size();
+    munmap((char*)stack - page, size + page);
+}
+
+// bytes of the stack used since the last call, called from the stack
+// itself once the handler returned; the pages below the caller are given
+// back, so the next task on the stack is measured on its own
+size_t stack_peak(void* stack, size_t size)
+{
+    size_t page = page_size();
+    char* low = stack;
+    char* sp = (char*)((unsigned long)&page & ~(page - 1));
+    unsigned char resident[SCAN_PAGES];
+    char* deepest = sp;
+
+    for (char* p = low; p < sp; p += SCAN_PAGES * page) {
+        size_t len = (size_t)(sp - p) < SCAN_PAGES * page ? (size_t)(sp - p) : SCAN_PAGES * page;
+        if (mincore(p, len, resident) < 0) {
+            return 0;
+        }
+        size_t i = 0;
+        while (i < len / page && !(resident[i] & 1)) {
+            ++i;
+        }
+        if (i < len / page) {
+            deepest = p + i * page;
+            break;
+        }
+    }
+
+    if (deepest < sp) {
+        madvise(deepest, sp - deepest, MADV_DONTNEED);
+    }
+    return low + size - deepest;
+}
@@ -0,0 +1,22 @@
+#ifndef TASK_STACK_H
+#define TASK_STACK_H
+#include <stddef.h>
+#include "so_scheduler.h"
+
+// stack of a task when so_opts_t.stack_size is 0
+#ifdef SO_GREEN
+#define STACK_DEFAULT_SIZE (256 * 1024)
+#else
+#define STACK_DEFAULT_SIZE (8 * 1024 * 1024)
+#endif
+#define STACK_MIN_SIZE (16 * 1024)
+
+size_t stack_size(const so_opts_t* opts);
+
+void* stack_alloc(size_t size);
+
+void stack_free(void* stack, size_t size);
+
+size_t stack_peak(void* stack, size_t size);
+
+#endif
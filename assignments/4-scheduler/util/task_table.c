@@ -0,0 +1,98 @@
+// tid -> thread hash table, chained through the hnext field of each thread
+// and grown when the chains get longer than two threads on average
+#include <stdlib.h>
+#include "types.h"
+#include "task_table.h"
+
+#define TABLE_MIN_BUCKETS 64
+
+static unsigned long hash_tid(tid_t tid, unsigned long mask)
+{
+    unsigned long h = (unsigned long)tid;
+    // pthread_t values are addresses, drop the aligned low bits
+    h ^= h >> 12;
+    h *= 0x9E3779B1UL;
+    return (h >> 7) & mask;
+}
+
+int table_init(task_table* t)
+{
+    t->buckets = calloc(TABLE_MIN_BUCKETS, sizeof(thread*));
+    if (t->buckets == NULL) {
+        return -1;
+    }
+    t->mask = TABLE_MIN_BUCKETS - 1;
+    t->no_elem = 0;
+    return 0;
+}
+
+void table_destroy(task_table* t)
+{
+    free(t->buckets);
+    t->buckets = NULL;
+}
+
+static void grow(task_table* t)
+{
+    unsigned long size = (t->mask + 1) * 2;
+    thread** buckets = calloc(size, sizeof(thread*));
+    if (buckets == NULL) {
+        // keep the longer chains, lookups still work
+        return;
+    }
+
+    for (unsigned long i = 0; i <= t->mask; ++i) {
+        thread* tr = t->buckets[i];
+        while (tr != NULL) {
+            thread* next = tr->hnext;
+            unsigned long b = hash_tid(tr->tid, size - 1);
+            tr->hnext = buckets[b];
+            buckets[b] = tr;
+            tr = next;
+        }
+    }
+
+    free(t->buckets);
+    t->buckets = buckets;
+    t->mask = size - 1;
+}
+
+void table_insert(task_table* t, thread* tr)
+{
+    if (t->no_elem >= 2 * (t->mask + 1)) {
+        grow(t);
+    }
+
+    unsigned long b = hash_tid(tr->tid, t->mask);
+    tr->hnext = t->buckets[b];
+    t->buckets[b] = tr;
+    tr->hashed = 1;
+    ++t->no_elem;
+}
+
+void table_remove(task_table* t, thread* tr)
+{
+    if (!tr->hashed) {
+        return;
+    }
+
+    thread** link = &t->buckets[hash_tid(tr->tid, t->mask)];
+    while (*link != NULL && *link != tr) {
+        link = &(*link)->hnext;
+    }
+    if (*link == tr) {
+        *link = tr->hnext;
+        --t->no_elem;
+    }
+    tr->hnext = NULL;
+    tr->hashed = 0;
+}
+
+thread* table_find(task_table* t, tid_t tid)
+{
+    thread* tr = t->buckets[hash_tid(tid, t->mask)];
+    while (tr != NULL && !pthread_equal(tr->tid, tid)) {
+        tr = tr->hnext;
+    }
+    return tr;
+}
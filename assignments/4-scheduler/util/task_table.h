@@ -0,0 +1,15 @@
+#ifndef TASK_TABLE_H
+#define TASK_TABLE_H
+#include "types.h"
+
+int table_init(task_table* t);
+
+void table_destroy(task_table* t);
+
+void table_insert(task_table* t, thread* tr);
+
+void table_remove(task_table* t, thread* tr);
+
+thread* table_find(task_table* t, tid_t tid);
+
+#endif
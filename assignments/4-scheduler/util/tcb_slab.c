@@ -0,0 +1,59 @@
+// Thread control blocks carved out of cache line aligned slabs, so no two
+// of them share a line. A zeroed tcb_slab is empty and ready to use, the
+// backends allocate their main thread before sched_init. Freed blocks are
+// kept on a free list linked through their next field, the slabs are only
+// released with the scheduler. Callers serialize the calls.
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "tcb_slab.h"
+
+// blocks per slab, the first block of each slab links to the next slab
+#define SLAB_BLOCKS 32
+
+static int grow(tcb_slab* s)
+{
+    thread* slab = aligned_alloc(TCB_ALIGN, SLAB_BLOCKS * sizeof(thread));
+    if (slab == NULL) {
+        return -1;
+    }
+
+    slab[0].next = s->slabs;
+    s->slabs = slab;
+    for (int i = SLAB_BLOCKS - 1; i > 0; --i) {
+        slab[i].next = s->free_list;
+        s->free_list = &slab[i];
+    }
+    return 0;
+}
+
+// returns a zeroed block or NULL if out of memory
+thread* tcb_alloc(tcb_slab* s)
+{
+    if (s->free_list == NULL && grow(s) < 0) {
+        return NULL;
+    }
+
+    thread* tr = s->free_list;
+    s->free_list = tr->next;
+    ++s->in_use;
+    memset(tr, 0, sizeof(*tr));
+    return tr;
+}
+
+void tcb_free(tcb_slab* s, thread* tr)
+{
+    tr->next = s->free_list;
+    s->free_list = tr;
+    --s->in_use;
+}
+
+void tcb_slab_destroy(tcb_slab* s)
+{
+    while (s->slabs != NULL) {
+        thread* next = s->slabs->next;
+        free(s->slabs);
+        s->slabs = next;
+    }
+    s->free_list = NULL;
+}
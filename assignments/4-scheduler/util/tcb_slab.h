@@ -0,0 +1,11 @@
+#ifndef TCB_SLAB_H
+#define TCB_SLAB_H
+#include "types.h"
+
+thread* tcb_alloc(tcb_slab* s);
+
+void tcb_free(tcb_slab* s, thread* tr);
+
+void tcb_slab_destroy(tcb_slab* s);
+
+#endif
@@ -0,0 +1,26 @@
+// Helpers shared by the tests. A test exits with 0 once all its checks
+// passed, otherwise it prints the first check that failed and exits
+// with 1.
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define check(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                    #cond);                                                 \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+static inline unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
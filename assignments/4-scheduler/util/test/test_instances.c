@@ -0,0 +1,116 @@
+// Calls into a scheduler from threads that are none of its tasks. A
+// plain pthread, then a task of another instance, signal a device and
+// fork a task while a low priority task of the scheduler runs inside its
+// handler on the only CPU. The woken and the forked task have to wait
+// for its next scheduler call, never run next to it.
+#include <pthread.h>
+#include <sched.h>
+#include "so_scheduler.h"
+#include "test.h"
+
+#define DEVICE 0
+// how long the low priority task keeps its CPU after the calls
+#define SPIN_NS 20000000ULL
+
+static so_sched_t* sched;
+// tasks of sched inside their handlers right now, and the most seen
+static int inside;
+static int max_inside;
+static int low_running;
+static int calls_done;
+
+static void enter_handler(void) {
+    int n = __atomic_add_fetch(&inside, 1, __ATOMIC_SEQ_CST);
+    int max = __atomic_load_n(&max_inside, __ATOMIC_SEQ_CST);
+
+    while (n > max && !__atomic_compare_exchange_n(&max_inside, &max, n, 0,
+                                                   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    }
+}
+
+static void leave_handler(void) {
+    __atomic_sub_fetch(&inside, 1, __ATOMIC_SEQ_CST);
+}
+
+static void high(unsigned int priority) {
+    (void)priority;
+    enter_handler();
+    leave_handler();
+}
+
+static void waiter(unsigned int priority) {
+    (void)priority;
+    enter_handler();
+    leave_handler();
+    so_wait(DEVICE);
+    enter_handler();
+    leave_handler();
+}
+
+// spins without scheduler calls until the outside calls are done, and a
+// while longer
+static void low(unsigned int priority) {
+    (void)priority;
+    enter_handler();
+    __atomic_store_n(&low_running, 1, __ATOMIC_SEQ_CST);
+    while (!__atomic_load_n(&calls_done, __ATOMIC_SEQ_CST)) {
+    }
+    unsigned long long start = now_ns();
+    while (now_ns() - start < SPIN_NS) {
+    }
+    leave_handler();
+    so_exec();
+}
+
+static void call_from_outside(void) {
+    while (!__atomic_load_n(&low_running, __ATOMIC_SEQ_CST)) {
+        sched_yield();
+    }
+    check(so_sched_signal(sched, DEVICE) == 1);
+    check(so_sched_fork(sched, high, SO_MAX_PRIO) != INVALID_TID);
+    __atomic_store_n(&calls_done, 1, __ATOMIC_SEQ_CST);
+}
+
+static void* outside_thread(void* arg) {
+    (void)arg;
+    call_from_outside();
+    return NULL;
+}
+
+static void foreign_task(unsigned int priority) {
+    (void)priority;
+    call_from_outside();
+}
+
+// the waiter runs first and blocks, then the low priority task gets the
+// CPU until the outside calls are done
+static void start_tasks(void) {
+    inside = 0;
+    max_inside = 0;
+    low_running = 0;
+    calls_done = 0;
+    sched = so_sched_create(100, 1, NULL);
+    check(sched != NULL);
+    check(so_sched_fork(sched, waiter, SO_MAX_PRIO - 1) != INVALID_TID);
+    check(so_sched_fork(sched, low, 0) != INVALID_TID);
+}
+
+int main(void) {
+    pthread_t outsider;
+
+    start_tasks();
+    check(pthread_create(&outsider, NULL, outside_thread, NULL) == 0);
+    pthread_join(outsider, NULL);
+    so_sched_destroy(sched);
+    check(max_inside == 1);
+
+    start_tasks();
+    check(so_init(100, 0) == 0);
+    check(so_fork(foreign_task, 0) != INVALID_TID);
+    so_end();
+    so_sched_destroy(sched);
+    check(max_inside == 1);
+
+    printf("test=instances ok\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+// Hierarchical timer wheel of sleeping threads. Level l has WHEEL_SLOTS
+// slots of WHEEL_SLOTS^l ticks each and a thread is linked into the
+// lowest level whose span covers the time it has left to sleep; when the
+// wheel reaches its slot it moves down a level, or expires on level 0.
+// Adding and cancelling are O(1); advancing visits only the slots that
+// hold threads, the empty ones are skipped with the occupancy bits.
+#include <stddef.h>
+#include "types.h"
+#include "timer_wheel.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+static unsigned int shift(unsigned int level)
+{
+    return level * WHEEL_BITS;
+}
+
+void wheel_init(timer_wheel* w, unsigned long long now)
+{
+    for (int i = 0; i < WHEEL_LEVELS; ++i) {
+        for (int j = 0; j < WHEEL_SLOTS; ++j) {
+            w->slots[i][j] = NULL;
+        }
+        w->occupied[i] = 0;
+    }
+    w->now = now;
+    w->no_elem = 0;
+}
+
+// links tr into the slot its wake_at falls in, seen from w->now
+static void link_timer(timer_wheel* w, thread* tr)
+{
+    unsigned long long delta = tr->wake_at - w->now;
+    unsigned int level = 0;
+
+    while (level < WHEEL_LEVELS - 1 && delta >> shift(level + 1) != 0) {
+        ++level;
+    }
+    unsigned int slot = (tr->wake_at >> shift(level)) & WHEEL_MASK;
+    thread** head = &w->slots[level][slot];
+
+    tr->tslot = level * WHEEL_SLOTS + slot;
+    tr->tprev = NULL;
+    tr->tnext = *head;
+    if (*head != NULL) {
+        (*head)->tprev = tr;
+    }
+    *head = tr;
+    w->occupied[level] |= 1ULL << slot;
+}
+
+static void unlink_timer(timer_wheel* w, thread* tr)
+{
+    unsigned int level = tr->tslot / WHEEL_SLOTS;
+    unsigned int slot = tr->tslot % WHEEL_SLOTS;
+
+    if (tr->tprev != NULL) {
+        tr->tprev->tnext = tr->tnext;
+    }
+    else {
+        w->slots[level][slot] = tr->tnext;
+    }
+    if (tr->tnext != NULL) {
+        tr->tnext->tprev = tr->tprev;
+    }
+    if (w->slots[level][slot] == NULL) {
+        w->occupied[level] &= ~(1ULL << slot);
+    }
+}
+
+// wake_at has to be after the current time of the wheel
+void wheel_add(timer_wheel* w, thread* tr, unsigned long long wake_at)
+{
+    tr->wake_at = wake_at;
+    tr->timer_armed = 1;
+    link_timer(w, tr);
+    ++w->no_elem;
+}
+
+void wheel_cancel(timer_wheel* w, thread* tr)
+{
+    if (!tr->timer_armed) {
+        return;
+    }
+    unlink_timer(w, tr);
+    tr->timer_armed = 0;
+    --w->no_elem;
+}
+
+// the time the wheel next has work to do: threads expire on level 0 or
+// move down from a higher level, never later than the first expiry
+// returns 0 if no thread sleeps
+int wheel_next(timer_wheel* w, unsigned long long* when)
+{
+    int found = 0;
+
+    for (unsigned int level = 0; level < WHEEL_LEVELS; ++level) {
+        unsigned long long occupied = w->occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+
+        // a level 0 slot is due from its first tick, the slot a higher
+        // level is in was already moved down, so its bit means a turn later
+        unsigned int cur = (w->now >> shift(level)) & WHEEL_MASK;
+        unsigned int first = level == 0 ? cur : cur + 1;
+        unsigned long long turn = w->now >> shift(level + 1) << shift(level + 1);
+        unsigned long long later = first < WHEEL_SLOTS ? occupied & (~0ULL << first) : 0;
+        unsigned long long t;
+
+        if (later != 0) {
+            t = turn + ((unsigned long long)__builtin_ctzll(later) << shift(level));
+        }
+        else {
+            t = turn + (1ULL << shift(level + 1)) +
+                ((unsigned long long)__builtin_ctzll(occupied) << shift(level));
+        }
+        if (!found || t < *when) {
+            *when = t;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// moves the wheel to now, expire is called for every thread whose time
+// came, after it left the wheel
+// returns the number of expired threads
+unsigned int wheel_advance(timer_wheel* w, unsigned long long now,
+                           void (*expire)(void* arg, thread* tr), void* arg)
+{
+    unsigned int expired = 0;
+    unsigned long long when;
+
+    while (w->no_elem > 0 && wheel_next(w, &when) && when <= now) {
+        w->now = when;
+
+        // higher levels first, their threads may land in a lower slot
+        // that is due at the same time
+        for (unsigned int level = WHEEL_LEVELS - 1; level > 0; --level) {
+            if ((when & ((1ULL << shift(level)) - 1)) != 0) {
+                continue;
+            }
+            unsigned int slot = (when >> shift(level)) & WHEEL_MASK;
+            thread* tr = w->slots[level][slot];
+            w->slots[level][slot] = NULL;
+            w->occupied[level] &= ~(1ULL << slot);
+            while (tr != NULL) {
+                thread* next = tr->tnext;
+                link_timer(w, tr);
+                tr = next;
+            }
+        }
+
+        thread* tr;
+        while ((tr = w->slots[0][when & WHEEL_MASK]) != NULL) {
+            unlink_timer(w, tr);
+            tr->timer_armed = 0;
+            --w->no_elem;
+            ++expired;
+            expire(arg, tr);
+        }
+    }
+    if (now > w->now) {
+        w->now = now;
+    }
+    return expired;
+}
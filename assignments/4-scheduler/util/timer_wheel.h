@@ -0,0 +1,16 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+#include "types.h"
+
+void wheel_init(timer_wheel* w, unsigned long long now);
+
+void wheel_add(timer_wheel* w, thread* tr, unsigned long long wake_at);
+
+void wheel_cancel(timer_wheel* w, thread* tr);
+
+int wheel_next(timer_wheel* w, unsigned long long* when);
+
+unsigned int wheel_advance(timer_wheel* w, unsigned long long now,
+                           void (*expire)(void* arg, thread* tr), void* arg);
+
+#endif
@@ -0,0 +1,139 @@
+// Scheduling event ring buffer and its Chrome trace / Perfetto export.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "trace.h"
+#include "sched_clock.h"
+
+static const char* event_names[] = {
+    [TRACE_FORK] = "fork",
+    [TRACE_RUN] = "run",
+    [TRACE_IDLE] = "idle",
+    [TRACE_PREEMPT] = "preempt",
+    [TRACE_QUANTUM] = "quantum",
+    [TRACE_WAIT] = "wait",
+    [TRACE_SIGNAL] = "signal",
+    [TRACE_WAKE] = "wake",
+    [TRACE_EXIT] = "exit",
+    [TRACE_SLEEP] = "sleep",
+    [TRACE_TIMEOUT] = "timeout",
+    [TRACE_JOIN] = "join",
+    [TRACE_WAIT_FD] = "wait_fd",
+    [TRACE_FD_READY] = "fd_ready",
+};
+
+trace_ring* trace_create(unsigned int no_events, const char* path) {
+    trace_ring* ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    // round up to a power of two so a slot is found with a mask
+    unsigned long size = 1;
+    while (size < no_events) {
+        size <<= 1;
+    }
+
+    ring->events = calloc(size, sizeof(trace_event));
+    ring->path = path != NULL ? strdup(path) : NULL;
+    if (ring->events == NULL || (path != NULL && ring->path == NULL)) {
+        trace_destroy(ring);
+        return NULL;
+    }
+    ring->mask = size - 1;
+    return ring;
+}
+
+void trace_destroy(trace_ring* ring) {
+    if (ring == NULL) {
+        return;
+    }
+    free(ring->events);
+    free(ring->path);
+    free(ring);
+}
+
+// claims a slot with a single atomic add, no lock is taken
+void trace_record(trace_ring* ring, unsigned int type, unsigned int cpu,
+                  const thread* tr, unsigned int arg) {
+    unsigned long long ts = now_ns();
+    unsigned long idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    trace_event* ev = &ring->events[idx & ring->mask];
+
+    ev->ts = ts;
+    ev->type = type;
+    ev->cpu = cpu;
+    ev->task = tr != NULL ? tr->id : 0;
+    ev->arg = arg;
+}
+
+static void dump_slice(FILE* f, int* sep, trace_event* ev,
+                       unsigned long long start, unsigned long long end) {
+    fprintf(f, "%s{\"name\":\"task %u\",\"cat\":\"run\",\"ph\":\"X\","
+            "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"prio\":%u}}",
+            *sep ? ",\n" : "", ev->task, (ev->ts - start) / 1000.0,
+            (end - ev->ts) / 1000.0, ev->cpu, ev->arg);
+    *sep = 1;
+}
+
+// the events are read without synchronization, dump while no task runs
+int trace_dump(trace_ring* ring, const char* path) {
+    unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    unsigned long first = head > ring->mask + 1 ? head - ring->mask - 1 : 0;
+    unsigned int ncpus = 1;
+
+    for (unsigned long i = first; i < head; ++i) {
+        if (ring->events[i & ring->mask].cpu >= ncpus) {
+            ncpus = ring->events[i & ring->mask].cpu + 1;
+        }
+    }
+
+    // run event that opened the current slice of each CPU
+    trace_event** open = calloc(ncpus, sizeof(trace_event*));
+    if (open == NULL) {
+        return -1;
+    }
+
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        free(open);
+        return -1;
+    }
+
+    unsigned long long start = ring->events[first & ring->mask].ts;
+    unsigned long long last = start;
+    int sep = 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (unsigned long i = first; i < head; ++i) {
+        trace_event* ev = &ring->events[i & ring->mask];
+        last = ev->ts;
+
+        if (ev->type == TRACE_RUN || ev->type == TRACE_IDLE) {
+            if (open[ev->cpu] != NULL) {
+                dump_slice(f, &sep, open[ev->cpu], start, ev->ts);
+            }
+            open[ev->cpu] = ev->type == TRACE_RUN ? ev : NULL;
+            continue;
+        }
+
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"sched\",\"ph\":\"i\",\"s\":\"t\","
+                "\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"task\":%u,\"arg\":%u}}",
+                sep ? ",\n" : "", event_names[ev->type], (ev->ts - start) / 1000.0,
+                ev->cpu, ev->task, ev->arg);
+        sep = 1;
+    }
+
+    for (unsigned int i = 0; i < ncpus; ++i) {
+        if (open[i] != NULL) {
+            dump_slice(f, &sep, open[i], start, last);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    free(open);
+
+    return fclose(f) == 0 ? 0 : -1;
+}
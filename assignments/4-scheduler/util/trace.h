@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+
+// events kept when SO_TRACE is set and so_opts_t.trace_events is 0
+#define TRACE_DEFAULT_EVENTS (64 * 1024)
+
+enum trace_type {
+    TRACE_FORK,
+    TRACE_RUN,
+    TRACE_IDLE,
+    TRACE_PREEMPT,
+    TRACE_QUANTUM,
+    TRACE_WAIT,
+    TRACE_SIGNAL,
+    TRACE_WAKE,
+    TRACE_EXIT,
+    TRACE_SLEEP,
+    TRACE_TIMEOUT,
+    TRACE_JOIN,
+    TRACE_WAIT_FD,
+    TRACE_FD_READY,
+};
+
+typedef struct trace_event {
+    unsigned long long ts;
+    unsigned int type;
+    unsigned int cpu;
+    unsigned int task;
+    unsigned int arg;
+} trace_event;
+
+// ring of the latest events, older ones are overwritten
+struct trace_ring {
+    trace_event* events;
+    unsigned long mask;
+    unsigned long head;
+    // written by so_end when set
+    char* path;
+};
+
+trace_ring* trace_create(unsigned int no_events, const char* path);
+
+void trace_destroy(trace_ring* ring);
+
+void trace_record(trace_ring* ring, unsigned int type, unsigned int cpu,
+                  const thread* tr, unsigned int arg);
+
+int trace_dump(trace_ring* ring, const char* path);
+
+// recording is a single branch while tracing is off
+static inline void trace(scheduler* sch, unsigned int type, unsigned int cpu,
+                         const thread* tr, unsigned int arg) {
+    if (sch->trace != NULL) {
+        trace_record(sch->trace, type, cpu, tr, arg);
+    }
+}
+
+#endif
@@ -1,35 +1,243 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <pthread.h>
+#ifdef SO_GREEN
+#include <ucontext.h>
+#endif
 #include "so_scheduler.h"
+#include "prio_bitmap.h"
+#include "rbtree.h"
 
-#define MAX_SIZE 1000
+// thread locals of the backends: the library is linked at startup, so
+// they can sit in the static TLS block and skip __tls_get_addr
+#define TLS_FAST __attribute__((tls_model("initial-exec")))
 
-typedef struct C_Queue {
-    void* elem[MAX_SIZE];
-    int front;
-    int rear;
-    int no_elem;
-} C_Queue;
+typedef struct thread thread;
+typedef struct trace_ring trace_ring;
+typedef struct replay_log replay_log;
+typedef struct sched_policy sched_policy;
 
-typedef struct thread {
+// intrusive queue, see task_queue.c
+typedef struct T_Queue {
+    thread* head;
+    thread* tail;
+    unsigned int no_elem;
+} T_Queue;
+
+// size of a cache line, every thread control block starts on its own
+#define TCB_ALIGN 64
+
+// the fields written on every scheduler call or switch of a thread come
+// first, so they share its first cache lines; the rest only changes on
+// fork, join, sleep or io
+struct thread {
     unsigned int time_quantum;
     unsigned int priority;
-    tid_t tid;
-    so_handler* func;
+    // ready queue level chosen by the policy, the priority unless the
+    // policy moves threads between levels
+    unsigned int level;
+    // virtual CPU the thread runs or is queued on
+    unsigned int cpu;
+    int edf;
     int work_done;
     int waiting;
-} thread;
+#ifndef SO_GREEN
+    // depth of the scheduler calls and instance locks the thread is in,
+    // SO_PREEMPT_SIGNAL never stops it there
+    int in_sched;
+    // asynchronous preemption of the thread, see preempt_signal
+    int preempt;
+#endif
+    // links inside the ready, waiting, idle or terminated queue, and the
+    // free list of the slab
+    thread* prev;
+    thread* next;
+    // when the thread entered a ready or waiting queue, 0 if unmeasured
+    unsigned long long ready_since;
+    unsigned long long wait_since;
+    so_task_stats_t stats;
+    // feedback queue policy: CPU clock when the thread last changed level
+    unsigned long long aged_at;
+    // weighted fair policy: virtual runtime and place in the ready tree,
+    // deadline tasks use the same node for their own tree
+    unsigned long long vruntime;
+    rb_node run_node;
+    // deadline task: period and budget as given to so_fork_deadline, the
+    // end of the current period and what is left of its budget
+    unsigned int period;
+    unsigned int budget;
+    unsigned long long deadline;
+    unsigned long long runtime;
+    unsigned long long run_start;
+
+    tid_t tid;
+    // scheduler the thread belongs to
+    struct scheduler* owner;
+    // fork order, 0 is the main thread
+    unsigned int id;
+    so_handler* func;
+    // set by so_fork when a handler is given to this thread
+    int assigned;
+    // a detached or joined thread is reclaimed once its handler returns,
+    // any other one is kept as a zombie until so_join or so_detach
+    int detached;
+    int zombie;
+    thread* joiner;
+    // the thread this one waits for inside so_join
+    thread* joining;
+    // lowest address of the stack, below it is the guard page
+    void* stack;
+#ifdef SO_GREEN
+    // saved registers of a user space task
+    ucontext_t ctx;
+#elif defined(SO_FUTEX)
+    // 0 while parked, 2 once asleep on it and 1 after unpark
+    unsigned int park_word;
+#else
+    // signaled only when this thread becomes the running one
+    pthread_cond_t run_cond;
+#endif
+    // chain inside the tid table
+    thread* hnext;
+    int hashed;
+    unsigned int wait_io;
+    // so_wait_fd: the descriptor and the events it became ready with
+    int wait_fd;
+    unsigned int fd_events;
+    // so_sleep and so_wait_timeout: when the thread wakes up, its links
+    // inside a timer wheel slot and whether the timeout came first
+    unsigned long long wake_at;
+    thread* tprev;
+    thread* tnext;
+    unsigned int tslot;
+    int timer_armed;
+    int timed_out;
+} __attribute__((aligned(TCB_ALIGN)));
+
+// thread control blocks of a scheduler, see tcb_slab.c
+typedef struct tcb_slab {
+    thread* slabs;
+    thread* free_list;
+    unsigned long in_use;
+} tcb_slab;
+
+// tid -> thread lookup, see task_table.c
+typedef struct task_table {
+    thread** buckets;
+    unsigned long mask;
+    unsigned long no_elem;
+} task_table;
+
+// sleeping threads, see timer_wheel.c
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 6
+
+typedef struct timer_wheel {
+    thread* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    // bit i of a level is set while its slot i holds threads
+    unsigned long long occupied[WHEEL_LEVELS];
+    unsigned long long now;
+    unsigned long no_elem;
+} timer_wheel;
+
+// io device, waiters are woken highest priority first
+typedef struct io_device {
+    T_Queue waiters[SO_MAX_PRIO + 1];
+    prio_bitmap waiting_mask;
+    // SO_IO_COUNTING: signals nobody waited for, consumed by so_wait
+    unsigned int mode;
+    unsigned int count;
+} io_device;
+
+// virtual CPU, runs at most one thread at a time
+typedef struct vcpu {
+    thread* running;
+    T_Queue ready_queues[SO_MAX_PRIO + 1];
+    prio_bitmap ready_mask;
+    // instructions run on this CPU by priority, only the running thread
+    // writes them so the lock free path of sched_charge can count too
+    unsigned long long instructions[SO_MAX_PRIO + 1];
+    // wall clock quantum: when the running thread has to give up the CPU
+    // and whether the timer already saw that time pass
+    unsigned long long slice_end;
+    int slice_expired;
+    // a thread that should preempt the running one was queued, the lock
+    // free so_exec path checks this instead of the ready queues
+    int need_resched;
+    // ready deadline threads by deadline, and the ones out of budget
+    rb_root edf_queue;
+    T_Queue throttled;
+    // ready threads of the weighted fair policy, by virtual runtime
+    rb_root fair_queue;
+    unsigned long long min_vruntime;
+} vcpu;
+
+// deepest stack use of the tasks of one handler
+typedef struct handler_stack {
+    so_handler* func;
+    unsigned long long tasks;
+    unsigned long long peak;
+} handler_stack;
 
 typedef struct scheduler {
     unsigned int time_quantum;
+    // time_quantum in nanoseconds, 0 when it counts scheduler calls
+    unsigned long long slice_ns;
+    int async_preempt;
     unsigned int io;
     unsigned int no_threads;
-    unsigned int no_terminated_threads;
-    thread* running_thread;
-    thread* terminated_threads[MAX_SIZE];
-    C_Queue ready_queues[SO_MAX_PRIO + 1];
-    C_Queue waiting_queues[SO_MAX_NUM_EVENTS + 1];
+    vcpu* cpus;
+    unsigned int ncpus;
+    // CPUs without a running thread
+    unsigned int idle_cpus;
+    // orders the ready threads, see sched_policy.h
+    const sched_policy* policy;
+    // share of the CPUs reserved by deadline tasks, see sched_deadline.c
+    unsigned long long edf_util;
+    // called when a thread becomes the running one of a CPU
+    void (*wake)(thread* tr);
+    thread* main_thread;
+    // the main thread gives the CPU to the first ready thread
+    int main_thread_running;
+    // the main thread gets the CPU whenever no task is ready
+    int main_idles;
+    // finished threads nobody joined or detached yet
+    T_Queue terminated_threads;
+    // memory of the forked threads and of the main thread
+    tcb_slab tcbs;
+    // finished threads kept alive to run future handlers
+    T_Queue idle_workers;
+    // workers that exited, the next fork joins one and reuses its stack
+    T_Queue exited_workers;
+    unsigned int pool_size;
+    // so_opts_t.detach
+    int detach_all;
+    // bytes of stack of every task, see task_stack.c, and the stack use
+    // measured for each handler while stats are on
+    unsigned long stack_size;
+    handler_stack* stacks;
+    unsigned int no_stacks;
+    int shutting_down;
+    // waiting threads of each io device
+    io_device* devices;
+    // threads sleeping or waiting with a timeout, and the scheduler calls
+    // skipped while every task slept, see sched_now
+    timer_wheel timers;
+    unsigned long long clock_skip;
+    // threads inside so_wait_fd
+    unsigned int fd_waiters;
+    // scheduling events, NULL while tracing is off
+    trace_ring* trace;
+    // recorded or replayed decisions, NULL unless SO_RECORD or SO_REPLAY
+    // is set, see replay.c
+    replay_log* replay;
+    // every forked thread by tid
+    task_table tasks;
+    // time measurements are taken only when set
+    int stats_on;
+    so_stats_t stats;
 } scheduler;
 
 #endif
\ No newline at end of file